@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Generate the file manifest for repositories with layout='manifest'.
+#
+# Usage: mkmanifest.sh <repository folder> [manifest name]
+#
+# Each line has the file SHA-256, length, modification time and the path
+# relative to the repository folder (URL escaped), separated by tabs.
+#
+
+set -o pipefail
+
+if [ -z "${1}" ] || [ ! -d "${1}" ]; then
+	echo "Usage: ${0} <repository folder> [manifest name]" >&2
+	exit 1
+fi
+
+REPOSITORY=$(readlink -f "${1}")
+MANIFEST="${2:-reinstall.manifest}"
+
+# Escape path for use in URLs, keeping the '/' separators.
+urlencode() {
+
+	local LC_ALL=C
+	local STRING="${1}"
+	local ENCODED=""
+	local CHAR
+	local INDEX
+
+	for (( INDEX=0; INDEX<${#STRING}; INDEX++ ))
+	do
+		CHAR="${STRING:INDEX:1}"
+		case "${CHAR}" in
+			[a-zA-Z0-9/._~-])
+				ENCODED+="${CHAR}"
+				;;
+			*)
+				ENCODED+=$(printf '%%%02X' "'${CHAR}")
+				;;
+		esac
+	done
+
+	echo "${ENCODED}"
+
+}
+
+TEMPFILE=$(mktemp) || exit 1
+trap 'rm -f "${TEMPFILE}"' EXIT
+
+echo "# reinstall manifest" > "${TEMPFILE}" || exit 1
+
+cd "${REPOSITORY}" || exit 1
+
+find . -type f ! -path "./${MANIFEST}" -printf '%P\0' | LC_ALL=C sort -z | while IFS= read -r -d '' FILENAME
+do
+
+	DIGEST=$(sha256sum -- "${FILENAME}" | cut -d' ' -f1)
+	if [ "$?" != "0" ] || [ "${#DIGEST}" != "64" ]; then
+		echo "${0}: Cant get SHA-256 of '${FILENAME}'" >&2
+		exit 1
+	fi
+
+	STAT=$(stat -c '%s %Y' -- "${FILENAME}")
+	if [ "$?" != "0" ]; then
+		echo "${0}: Cant get length of '${FILENAME}'" >&2
+		exit 1
+	fi
+
+	printf '%s\t%s\t%s\t%s\n' "${DIGEST}" ${STAT} "$(urlencode "${FILENAME}")" >> "${TEMPFILE}" || exit 1
+
+done
+
+if [ "$?" != "0" ]; then
+	exit 1
+fi
+
+install -m 644 "${TEMPFILE}" "${REPOSITORY}/${MANIFEST}" || exit 1
+echo "${REPOSITORY}/${MANIFEST}: $(($(wc -l < "${REPOSITORY}/${MANIFEST}") - 1)) file(s)"
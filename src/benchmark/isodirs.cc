@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /**
+  * @brief Microbenchmark for the iso9660 builder directory lookup.
+  *
+  * Resolves the directory of synthetic file paths on a libisofs image using the
+  * old method (split the path, search every level from the root) and the one
+  * from iso9660::Builder::getIsoDir() (directory map, only missing levels are
+  * searched).
+  *
+  * Usage: isodirs [files] [depth]
+  */
+
+ #include <libisofs/libisofs.h>
+ #include <iostream>
+ #include <string>
+ #include <vector>
+ #include <unordered_map>
+ #include <stdexcept>
+ #include <chrono>
+ #include <cstdlib>
+
+ using namespace std;
+
+ static IsoDir * add(IsoImage *image, IsoDir *parent, const char *name) {
+
+	IsoNode *node;
+	int rc = iso_image_dir_get_node(image,parent,name,&node,0);
+	if(rc == 0) {
+		rc = iso_tree_add_new_dir(parent, name, (IsoDir **) &node);
+	}
+
+	if(rc < 0) {
+		throw runtime_error(iso_error_to_msg(rc));
+	}
+
+	return (IsoDir *) node;
+
+ }
+
+ /// @brief The old lookup, walk the path from the root.
+ static IsoDir * walk(IsoImage *image, const std::string &path) {
+
+	IsoDir *dir = iso_image_get_root(image);
+
+	size_t from = 0;
+	while(from < path.size()) {
+		size_t to = path.find('/',from);
+		if(to == string::npos) {
+			to = path.size();
+		}
+		dir = add(image,dir,path.substr(from,to-from).c_str());
+		from = to+1;
+	}
+
+	return dir;
+
+ }
+
+ /// @brief The builder lookup, same as iso9660::Builder::getIsoDir().
+ static IsoDir * lookup(IsoImage *image, std::unordered_map<std::string, IsoDir *> &dirs, const std::string &path) {
+
+	if(path.empty()) {
+		return iso_image_get_root(image);
+	}
+
+	auto it = dirs.find(path);
+	if(it != dirs.end()) {
+		return it->second;
+	}
+
+	IsoDir *parent;
+	const char *name;
+
+	auto pos = path.rfind('/');
+	if(pos == string::npos) {
+		parent = iso_image_get_root(image);
+		name = path.c_str();
+	} else {
+		parent = lookup(image,dirs,path.substr(0,pos));
+		name = path.c_str() + pos + 1;
+	}
+
+	IsoDir *dir = add(image,parent,name);
+	dirs[path] = dir;
+	return dir;
+
+ }
+
+ /// @brief Run lookups for all paths on a new image.
+ /// @return Elapsed time in milliseconds.
+ template <typename T>
+ static double run(const char *title, const std::vector<std::string> &paths, T call) {
+
+	IsoImage *image;
+	if(!iso_image_new("benchmark", &image)) {
+		throw runtime_error("Cant create image");
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	for(const std::string &path : paths) {
+		if(!call(image,path)) {
+			throw logic_error("Directory lookup has failed");
+		}
+	}
+
+	double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	iso_image_unref(image);
+
+	cout << title << "\t" << paths.size() << " paths in " << elapsed << "ms" << endl;
+	return elapsed;
+
+ }
+
+ int main(int argc, char **argv) {
+
+	size_t files = (argc > 1 ? strtoul(argv[1],NULL,10) : 100000);
+	size_t depth = (argc > 2 ? strtoul(argv[2],NULL,10) : 8);
+
+	if(!(files && depth)) {
+		cerr << "Usage: " << argv[0] << " [files] [depth]" << endl;
+		return 1;
+	}
+
+	// Synthetic tree, 16 subfolders by level, files spread on all levels like a distribution tree.
+	std::vector<std::string> paths;
+	paths.reserve(files);
+
+	for(size_t file = 0; file < files; file++) {
+
+		std::string path;
+		size_t levels = 1 + (file % depth);
+		size_t seed = file;
+
+		for(size_t level = 0; level < levels; level++) {
+			if(!path.empty()) {
+				path += '/';
+			}
+			path += "dir";
+			path += to_string(seed % 16);
+			seed /= 3;
+		}
+
+		paths.push_back(path);
+
+	}
+
+	if(iso_init() < 0) {
+		cerr << "Cant initialize libisofs" << endl;
+		return 1;
+	}
+
+	try {
+
+		double before = run("walk",paths,[](IsoImage *image, const std::string &path){
+			return walk(image,path);
+		});
+
+		std::unordered_map<std::string, IsoDir *> dirs;
+		double after = run("map",paths,[&dirs](IsoImage *image, const std::string &path){
+			return lookup(image,dirs,path);
+		});
+
+		cout << dirs.size() << " directories, speedup " << (after > 0 ? before / after : 0) << "x" << endl;
+
+	} catch(const std::exception &e) {
+
+		cerr << e.what() << endl;
+		iso_finish();
+		return 1;
+
+	}
+
+	iso_finish();
+	return 0;
+
+ }
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <reinstall/defs.h>
+ #include <string>
+ #include <mutex>
+ #include <unordered_set>
+ #include <functional>
+ #include <vector>
+ #include <ctime>
+
+ namespace Reinstall {
+
+	/// @brief Persistent download cache.
+	/// @details Files are stored by a key built from the URL, with the server validators (ETag, Last-Modified and size)
+	///          on a '.meta' file; cached files are revalidated with a conditional request (If-None-Match/If-Modified-Since)
+	///          and older entries are removed when the cache grows beyond the configured size.
+	class UDJAT_PRIVATE Cache {
+	public:
+
+		/// @brief Server validators for an URL.
+		struct Validators {
+
+			std::string etag;
+			std::string modified;
+			unsigned long long length = 0LL;
+
+			/// @brief Does the server accept range requests?
+			bool ranges = false;
+
+			Validators() = default;
+
+			/// @brief Get validators from server.
+			Validators(const char *url);
+
+			/// @brief Load validators from cache metadata.
+			/// @return true if the metadata is valid for the url.
+			bool load(const char *filename, const char *url);
+
+			/// @brief Save validators to cache metadata.
+			void save(const char *filename, const char *url) const;
+
+			/// @brief Check if the validators are from the same file.
+			bool operator==(const Validators &v) const noexcept;
+
+			/// @brief Can the URL be cached?
+			inline operator bool() const noexcept {
+				return !(etag.empty() && modified.empty()) || length;
+			}
+
+		};
+
+		/// @brief Expanded directory listing.
+		struct Listing {
+
+			struct Item {
+				std::string url;					///< @brief The file URL.
+				std::string path;					///< @brief The path inside the image.
+				unsigned long long length = 0;		///< @brief File length (0 if unknown).
+				time_t mtime = 0;					///< @brief File modification time (0 if unknown).
+			};
+
+			std::vector<Item> items;
+
+			/// @brief When the listing was saved.
+			time_t updated = 0;
+
+		};
+
+	private:
+
+		std::mutex guard;
+
+		/// @brief Path for cache files (empty if disabled).
+		std::string path;
+
+		/// @brief Maximum cache size in bytes.
+		unsigned long long maxlength;
+
+		/// @brief Files referenced by this session (never evicted).
+		std::unordered_set<std::string> active;
+
+		Cache();
+
+		/// @brief Build cache key.
+		static std::string key(const char *url);
+
+		/// @brief Revalidate cached file with a conditional request.
+		/// @param url The file URL.
+		/// @param filename The cached file name.
+		/// @param validators Updated with the server validators when the file was modified.
+		/// @return true if the cached file is valid.
+		bool revalidate(const char *url, const std::string &filename, Validators &validators);
+
+		/// @brief Remove least recently used files until the cache fits in maxlength.
+		/// @details Partial downloads kept for resume are included, called with the guard locked.
+		void evict();
+
+	public:
+		Cache(const Cache &) = delete;
+		Cache(const Cache *) = delete;
+
+		static Cache & getInstance();
+
+		/// @brief Is the cache available?
+		inline operator bool() const noexcept {
+			return !path.empty();
+		}
+
+		/// @brief Get cached file for URL, download it if necessary.
+		/// @param url The file URL.
+		/// @param download Method to download the file to the supplied filename.
+		/// @return The cached filename (empty if the URL cant be cached).
+		std::string get(const char *url, const std::function<void(const char *filename)> &download);
+
+		/// @brief Check if the cache has a complete copy of the URL (without revalidating it).
+		/// @param url The file URL.
+		/// @return true if the URL is on the cache.
+		bool contains(const char *url);
+
+		/// @brief Load expanded directory listing.
+		/// @param url The folder URL.
+		/// @param path The folder path inside the image.
+		/// @param listing The listing to load.
+		/// @return true if the listing was loaded.
+		bool load(const char *url, const char *path, Listing &listing);
+
+		/// @brief Save expanded directory listing.
+		/// @param url The folder URL.
+		/// @param path The folder path inside the image.
+		/// @param listing The listing to save.
+		void save(const char *url, const char *path, const Listing &listing);
+
+		/// @brief Get text file (ex: directory index) using the cache if available.
+		/// @details The blocks are delivered as they are received, the file is never fully loaded in memory.
+		/// @param url The file URL.
+		/// @param call The method to call on every block.
+		void text(const char *url, const std::function<void(const char *text, size_t length)> &call);
+
+	};
+
+ }
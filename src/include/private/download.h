@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <reinstall/defs.h>
+ #include <reinstall/checksum.h>
+ #include <functional>
+
+ namespace Reinstall {
+
+	namespace Download {
+
+		/// @brief Download URL to file using the best available method.
+		/// @details Large files from servers accepting range requests are fetched in segments, others with resumable().
+		/// @param url The file URL.
+		/// @param filename The target filename.
+		/// @param progress The progress callback.
+		/// @param persistent If true the filename is stable between runs.
+		/// @param checksum If not null verify the downloaded data, the file is removed on mismatch.
+		/// @param length The file length if already known (from listing or manifest), 0 to ask the server.
+		void file(const char *url, const char *filename, const std::function<void(double current, double total)> &progress, bool persistent = false, Checksum *checksum = nullptr, unsigned long long length = 0);
+
+		/// @brief Download URL to file using the metalink (.meta4) published by the server.
+		/// @details Pieces are fetched from several mirrors at the same time, every piece is verified using
+		///          the metalink piece hash and fetched again from another mirror if corrupted.
+		/// @param url The file URL.
+		/// @param filename The target filename.
+		/// @param length The file length.
+		/// @param progress The progress callback (aggregated for all pieces).
+		/// @return false if the server has no usable metalink for the URL.
+		bool metalink(const char *url, const char *filename, unsigned long long length, const std::function<void(double current, double total)> &progress);
+
+		/// @brief Copy local file without moving the data through user space.
+		/// @details Uses a reflink when both files are on the same filesystem, then copy_file_range(),
+		///          sendfile() and, if none of them is available, read/write.
+		/// @param from The source file.
+		/// @param to The target file.
+		/// @param progress The progress callback.
+		void copy(const char *from, const char *to, const std::function<void(double current, double total)> &progress);
+
+		/// @brief Allocate disk space for file.
+		/// @param fd The file descriptor.
+		/// @param filename The file name (for error messages).
+		/// @param length The file length.
+		/// @param resize If false just reserve the blocks, keeping the current file size.
+		void preallocate(int fd, const char *filename, unsigned long long length, bool resize = true);
+
+		/// @brief Download URL to file using parallel range requests.
+		/// @details The file is preallocated and every segment is written on its own region with pwrite().
+		/// @param url The file URL.
+		/// @param filename The target filename.
+		/// @param length The file length.
+		/// @param progress The progress callback (aggregated for all segments).
+		void segmented(const char *url, const char *filename, unsigned long long length, const std::function<void(double current, double total)> &progress);
+
+		/// @brief Download URL to file, resuming from the partial data of a previous attempt.
+		/// @details Data is written on 'filename.part' with the server validators in 'filename.info'; the
+		///          transfer is restarted from the last offset using range requests when it fails or stalls.
+		/// @param url The file URL.
+		/// @param filename The target filename.
+		/// @param progress The progress callback.
+		/// @param persistent If true keep the partial data when the download fails (filename is stable between runs).
+		/// @param checksum If not null verify the data while downloading, the file is removed on mismatch.
+		void resumable(const char *url, const char *filename, const std::function<void(double current, double total)> &progress, bool persistent = false, Checksum *checksum = nullptr);
+
+	}
+
+ }
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <mutex>
+ #include <ctime>
+ #include <functional>
+
+ namespace Reinstall {
+
+	/// @brief Aggregated byte count for all downloads, reports total progress and ETA.
+	class UDJAT_PRIVATE Meter {
+	private:
+		std::mutex guard;
+
+		/// @brief Counting received bytes?
+		bool active = false;
+
+		/// @brief Bytes to download (0 if unknown).
+		unsigned long long total = 0;
+
+		/// @brief Bytes received since start().
+		unsigned long long received = 0;
+
+		/// @brief Sources applied (for the 'n of m' step).
+		size_t current = 0;
+
+		/// @brief Number of sources.
+		size_t count = 0;
+
+		time_t started = 0;
+		time_t updated = 0;
+
+		/// @brief Bytes received by background workers not yet shown.
+		bool pending = false;
+
+		Meter() = default;
+
+		/// @brief Update the progress dialog (guard locked).
+		void refresh();
+
+	public:
+		Meter(const Meter &) = delete;
+		Meter(const Meter *) = delete;
+
+		/// @brief Mark the current thread as a background worker while in scope.
+		/// @details The progress dialog isn't thread safe, only the action thread can update it;
+		///          the transfers on background workers are reported by the aggregated byte count.
+		class UDJAT_PRIVATE Background {
+		private:
+			bool saved;
+
+		public:
+			Background() noexcept;
+			~Background() noexcept;
+		};
+
+		/// @brief Is the current thread a background worker?
+		static bool background() noexcept;
+
+		/// @brief Progress dialog proxy for the transfers, ignores the calls from background workers.
+		class UDJAT_PRIVATE Progress {
+		public:
+			void set_title(const char *title);
+			void set_sub_title(const char *subtitle);
+			void set_url(const char *url);
+			void set_progress(double current, double total);
+			void pulse();
+		};
+
+		static Meter & getInstance();
+
+		/// @brief Get human readable size.
+		static std::string format(unsigned long long bytes);
+
+		/// @brief Start accounting, the bytes received from now on are counted.
+		void start();
+
+		/// @brief Set the totals, start reporting progress.
+		/// @param total Number of bytes to download.
+		/// @param count Number of sources to apply.
+		void set_total(unsigned long long total, size_t count);
+
+		/// @brief Stop accounting, clear the progress step.
+		void stop();
+
+		/// @brief Add received bytes (any thread).
+		void add(unsigned long long bytes);
+
+		/// @brief Show the bytes received by the background workers (action thread only).
+		void update();
+
+		/// @brief Update the number of applied sources.
+		void set_count(size_t current);
+
+		/// @brief Wrap a transfer progress callback, adding the received bytes to the meter.
+		/// @param progress The per-file progress callback.
+		/// @return Callback for the transfer.
+		static std::function<void(double current, double total)> wrap(const std::function<void(double current, double total)> &progress);
+
+	};
+
+ }
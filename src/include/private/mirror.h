@@ -20,18 +20,51 @@
  #pragma once
  #include <config.h>
  #include <reinstall/defs.h>
+ #include <reinstall/repository.h>
+ #include <string>
+ #include <vector>
+ #include <memory>
+ #include <functional>
+ #include <ctime>
 
  namespace Reinstall {
 
 	namespace Mirror {
 
-		/// @brief Mirror from apache web server.
-		void apache(const char *name, const char *path, const char *url, std::vector<std::shared_ptr<Source>> &contents);
+		/// @brief Entry from a folder index.
+		struct Entry {
+			std::string url;					///< @brief The remote URL.
+			std::string path;					///< @brief The path inside the image.
+			bool folder = false;				///< @brief Is the entry a folder?
+			unsigned long long length = 0;		///< @brief File length (0 if unknown).
+			time_t mtime = 0;					///< @brief File modification time (0 if unknown).
+			std::string sha256;					///< @brief File digest (empty if unknown).
+		};
 
-		void mirrorcache(const char *name, const char *path, const char *url, std::vector<std::shared_ptr<Source>> &contents);
-	}
+		/// @brief Get folder index from apache web server (non recursive).
+		void apache(const char *path, const char *url, const std::function<void(const Entry &entry)> &call);
 
- }
+		/// @brief Get folder index from MirrorCache (non recursive).
+		void mirrorcache(const char *path, const char *url, const std::function<void(const Entry &entry)> &call);
+
+		/// @brief Get folder files from the repository manifest.
+		/// @param path The folder path inside the image.
+		/// @param url The folder URL.
+		/// @param base The repository URL.
+		/// @param manifest The manifest name (relative to the repository URL).
+		/// @param call The method to call for every file in the folder (or subfolders).
+		void manifest(const char *path, const char *url, const char *base, const char *manifest, const std::function<void(const Entry &entry)> &call);
 
+		/// @brief Expand remote folder, subfolders are loaded in parallel.
+		/// @param path The folder path inside the image.
+		/// @param url The folder URL.
+		/// @param layout The repository layout.
+		/// @param factory Create the source for a file entry, called from the loading thread as soon as the entry is parsed.
+		/// @param contents Vector for the folder sources, in index order.
+		/// @param files Vector for the folder file entries, in index order.
+		void expand(const char *path, const char *url, Repository::Layout layout, const std::function<std::shared_ptr<Source>(const Entry &entry)> &factory, std::vector<std::shared_ptr<Source>> &contents, std::vector<Entry> &files);
 
+	}
+
+ }
 
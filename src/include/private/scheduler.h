@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <reinstall/defs.h>
+ #include <reinstall/source.h>
+ #include <memory>
+ #include <list>
+ #include <vector>
+ #include <unordered_set>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <exception>
+ #include <functional>
+
+ namespace Reinstall {
+
+	/// @brief Download sources in parallel, deliver them to the caller thread.
+	/// @details Remote sources are saved on worker threads; the builder is always called from the thread running for_each()
+	///          so non thread-safe builders (libisofs, fatfs) keeps working as before.
+	///          Sources can be prefetched while the file list is still being built; only the ones
+	///          inserted with push_back() are delivered to for_each().
+	class UDJAT_PRIVATE Scheduler {
+	private:
+
+		std::mutex guard;
+		std::condition_variable changed;
+
+		/// @brief Sources waiting for download.
+		std::list<std::shared_ptr<Source>> pending;
+
+		/// @brief Sources ready to apply.
+		std::list<std::shared_ptr<Source>> ready;
+
+		/// @brief Sources on the pending list.
+		std::unordered_set<const Source *> queued;
+
+		/// @brief Sources being saved.
+		std::unordered_set<const Source *> busy;
+
+		/// @brief Sources inserted with push_back() and not yet ready.
+		std::unordered_set<const Source *> wanted;
+
+		/// @brief Number of sources inserted with push_back().
+		size_t requested = 0;
+
+		/// @brief Accepting prefetch requests (workers waits for new sources).
+		bool open = true;
+
+		/// @brief Active download threads.
+		std::vector<std::thread> threads;
+
+		/// @brief Exception from the first failed download.
+		std::exception_ptr failed;
+
+		/// @brief Stop workers.
+		bool cancelled = false;
+
+		/// @brief Maximum number of simultaneous downloads.
+		unsigned int limit;
+
+		/// @brief Download thread.
+		void worker();
+
+		/// @brief Start worker threads up to the limit.
+		void start(size_t count);
+
+		/// @brief Stop and wait for all workers.
+		void stop() noexcept;
+
+	public:
+		Scheduler(const Scheduler &) = delete;
+		Scheduler(const Scheduler *) = delete;
+
+		/// @brief Create download scheduler.
+		/// @param workers Number of simultaneous downloads (0 to use the configured value).
+		Scheduler(unsigned int workers = 0);
+		~Scheduler();
+
+		/// @brief Get the configured number of simultaneous downloads.
+		static unsigned int workers();
+
+		/// @brief Start download before the source is required.
+		/// @details Failures are ignored; the source is downloaded again if required.
+		void prefetch(std::shared_ptr<Source> source);
+
+		/// @brief Insert source.
+		/// @param source The source to insert.
+		/// @param download If false deliver the source without downloading it.
+		void push_back(std::shared_ptr<Source> source, bool download = true);
+
+		/// @brief Wait for sources, call 'apply' on the current thread for every one of them.
+		/// @param apply The method to call when the source is ready.
+		void for_each(const std::function<void(Source &source)> &apply);
+
+	};
+
+ }
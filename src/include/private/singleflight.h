@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <reinstall/defs.h>
+ #include <string>
+ #include <memory>
+ #include <functional>
+ #include <exception>
+
+ namespace Reinstall {
+
+	/// @brief Share the transfer of the same URL between sources, templates and actions.
+	/// @details Concurrent requests for an URL wait for the first one; the result file is reused while
+	///          any requester keeps a reference to the transfer.
+	class UDJAT_PRIVATE SingleFlight {
+	public:
+
+		/// @brief The result of a transfer.
+		class Transfer {
+		private:
+			friend class SingleFlight;
+
+			/// @brief Temporary file owned by the transfer.
+			std::string temp;
+
+			bool done = false;
+			std::exception_ptr failed;
+
+		public:
+
+			/// @brief The file with the URL contents.
+			std::string filename;
+
+			~Transfer();
+
+		};
+
+		/// @brief Get URL contents, sharing the transfer with the other requests for the same URL.
+		/// @param url The URL.
+		/// @param fetch Get the URL contents; receives a temporary file name, returns the file with the contents.
+		/// @return The transfer, keep it while using the file.
+		static std::shared_ptr<Transfer> get(const char *url, const std::function<std::string(const char *tempname)> &fetch);
+
+	};
+
+ }
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <vector>
+ #include <deque>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <exception>
+ #include <functional>
+
+ namespace Reinstall {
+
+	/// @brief Bounded pool of worker threads for nested tasks.
+	/// @details Tasks can push new tasks on the same queue; a thread waiting for a group runs
+	///          pending tasks instead of blocking, so nested waits can't exhaust the workers.
+	class UDJAT_PRIVATE WorkQueue {
+	public:
+
+		/// @brief Set of tasks to wait for.
+		class Group {
+		private:
+			friend class WorkQueue;
+			size_t pending = 0;
+			std::exception_ptr failed;
+		};
+
+	private:
+
+		struct Task {
+			Group *group = nullptr;
+			std::function<void()> call;
+		};
+
+		std::mutex guard;
+		std::condition_variable changed;
+
+		/// @brief Tasks waiting for a thread.
+		std::deque<Task> tasks;
+
+		/// @brief Worker threads.
+		std::vector<std::thread> threads;
+
+		/// @brief Maximum number of worker threads.
+		unsigned int limit;
+
+		bool stopping = false;
+
+		/// @brief Run task, update group.
+		void run(Task &task) noexcept;
+
+		/// @brief Worker thread.
+		void worker();
+
+	public:
+		WorkQueue(const WorkQueue &) = delete;
+		WorkQueue(const WorkQueue *) = delete;
+
+		/// @brief Create work queue.
+		/// @param workers Number of threads (0 to use the configured value).
+		WorkQueue(unsigned int workers = 0);
+		~WorkQueue();
+
+		/// @brief Get the configured number of threads for source expansion.
+		static unsigned int workers();
+
+		/// @brief Get the work queue running the current thread.
+		/// @return The active queue or nullptr if the thread isn't running tasks.
+		static WorkQueue * current() noexcept;
+
+		/// @brief Insert task.
+		/// @param group The task group.
+		/// @param task The task to run.
+		void push(Group &group, const std::function<void()> &task);
+
+		/// @brief Run pending tasks until all tasks of the group are complete.
+		/// @param group The task group.
+		/// @exception The first exception thrown by a task in the group.
+		void wait(Group &group);
+
+	};
+
+ }
@@ -38,6 +38,7 @@
  namespace Reinstall {
 
  	class Worker;
+ 	class Scheduler;
 
 	class UDJAT_API Action : public Abstract::Object {
 	public:
@@ -82,8 +83,8 @@
 			/// @brief Template URL.
 			const char *url;
 
-			/// @brief Template file name.
-			std::string filename;
+			/// @brief Expanded template contents.
+			std::shared_ptr<const std::string> contents;
 
 			/// @brief Template path (can be null).
 			const char *path = nullptr;
@@ -94,6 +95,9 @@
 			/// @brief Is an script?
 			bool script = false;
 
+			/// @brief Keep a copy in the download cache?
+			bool cache = false;
+
 		public:
 
 			Template(const char *n, const char *u, const char *p = nullptr) : name{n}, url{u}, path{p} {
@@ -111,10 +115,6 @@
 				return path;
 			}
 
-			inline const char * get_filename() const noexcept {
-				return filename.c_str();
-			}
-
 			inline const char * get_url() const noexcept {
 				return url;
 			}
@@ -192,9 +192,27 @@
 
 		Action(const pugi::xml_node &node, const char *icon_name = "");
 
+		/// @brief Get the space available for the sources in the image.
+		/// @return The image capacity in bytes, 0 if unknown.
+		virtual unsigned long long capacity() const noexcept;
+
+		/// @brief Get the length of all sources, fail early if they doesn't fit.
+		/// @details Lengths not available from the folder listings are requested from the server.
+		/// @return The number of bytes to download.
+		unsigned long long measure();
+
 	private:
 		static Action * selected;		///< @brief Selected action.
 
+		/// @brief Download scheduler accepting prefetch requests while loading sources.
+		Scheduler *scheduler = nullptr;
+
+		/// @brief Insert local folders as a whole instead of expanding them?
+		bool grafting = false;
+
+		/// @brief The image builder, while running pre().
+		const Builder *target = nullptr;
+
 		struct {
 			Dialog::Popup confirmation;
 			Dialog::Popup success;
@@ -284,6 +302,16 @@
 
 		bool push_back(std::shared_ptr<Template> tmpl);
 
+		/// @brief Can the local folders be inserted as a whole?
+		/// @details Only while loading sources for a builder accepting folders.
+		inline bool graft() const noexcept {
+			return grafting;
+		}
+
+		/// @brief Start source download while the file list is still loading.
+		/// @details Does nothing if the action isn't loading or the source will be replaced by a template.
+		void prefetch(std::shared_ptr<Source> source) const;
+
 		inline size_t source_count() const noexcept {
 			return sources.size();
 		}
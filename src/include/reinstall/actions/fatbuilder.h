@@ -45,6 +45,8 @@
 		/// @brief Create an image writer.
 		std::shared_ptr<Reinstall::Writer> WriterFactory() override;
 
+		unsigned long long capacity() const noexcept override;
+
 	};
 
  }
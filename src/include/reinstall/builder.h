@@ -42,6 +42,14 @@
 		/// @return true if source was downloaded.
 		virtual bool apply(Source &source);
 
+		/// @brief Can the builder insert local folders as a whole?
+		/// @return true if apply() accepts file:// folder sources.
+		virtual bool graft() const noexcept;
+
+		/// @brief Can the source contents be read only when writing the image?
+		/// @return true if apply() doesn't need the source saved on a local file.
+		virtual bool lazy(const Source &source) const noexcept;
+
 		/// @brief Step 3, build (after downloads).
 		virtual void build(Action &action) = 0;
 
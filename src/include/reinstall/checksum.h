@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+
+ #include <udjat/defs.h>
+ #include <cstddef>
+ #include <string>
+
+ namespace Reinstall {
+
+	/// @brief Incremental digest verifier (SHA-256 by default).
+	class UDJAT_API Checksum {
+	private:
+		class Context;
+		Context *context = nullptr;
+
+		/// @brief The expected digest (lowercase hex).
+		std::string expected;
+
+		/// @brief Finalize digest.
+		/// @return The computed digest (lowercase hex).
+		std::string finalize();
+
+	public:
+		/// @brief Create verifier.
+		/// @param expected The expected digest.
+		/// @param type The digest type, using metalink names (sha-256, sha-1, ...).
+		Checksum(const char *expected, const char *type = "sha-256");
+		~Checksum();
+
+		Checksum(const Checksum &) = delete;
+		Checksum(const Checksum *) = delete;
+
+		/// @brief Get expected digest from a checksum file (sha256sum format).
+		/// @details The checksum file is downloaded and parsed once per URL.
+		/// @param url The checksum file URL.
+		/// @param filename The name of the file to search for.
+		/// @return The expected digest.
+		/// @exception std::runtime_error if the file has no digest for filename.
+		static std::string fetch(const char *url, const char *filename);
+
+		/// @brief Compute file digest.
+		/// @param filename The file name.
+		/// @param type The digest type.
+		/// @return The file digest (lowercase hex).
+		static std::string compute(const char *filename, const char *type = "sha-256");
+
+		/// @brief Restart digest.
+		void reset();
+
+		/// @brief Add data to digest.
+		void update(const void *buf, size_t length);
+
+		/// @brief Add file contents to digest.
+		void update(const char *filename);
+
+		/// @brief Finalize digest.
+		/// @return true if the digest matches the expected value.
+		bool test();
+
+		/// @brief Finalize digest, throw if it doesn't match the expected value.
+		/// @param url The source URL (for the error message).
+		void verify(const char *url);
+
+	};
+
+ }
@@ -27,6 +27,7 @@
 	class Builder;
 	class Source;
 	class Action;
+	class Repository;
 
 	namespace Dialog {
 
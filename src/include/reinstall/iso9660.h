@@ -24,9 +24,16 @@
  #include <udjat/tools/object.h>
  #include <reinstall/builder.h>
  #include <reinstall/writer.h>
+ #include <string>
+ #include <vector>
+ #include <unordered_map>
+ #include <memory>
+ #include <atomic>
 
  typedef struct Iso_Image IsoImage;
  typedef struct iso_write_opts IsoWriteOpts;
+typedef struct Iso_Dir IsoDir;
+typedef struct iso_stream IsoStream;
 
  namespace Reinstall {
 
@@ -38,9 +45,54 @@
 			IsoImage *image = nullptr;
 			IsoWriteOpts *opts;
 
+			/// @brief Store files with the same contents only once?
+			bool dedup = true;
+
+			/// @brief File already in the image.
+			struct Stored {
+				std::string filename;
+				std::string digest;		///< @brief File digest, computed when another file has the same length.
+			};
+
+			/// @brief Files already in the image, by length.
+			std::unordered_map<unsigned long long, std::vector<Stored>> stored;
+
+			/// @brief Read remote sources only when writing the image?
+			bool streams = false;
+
+			/// @brief Streams failed while writing the image.
+			std::shared_ptr<std::atomic<unsigned int>> failures;
+
+			/// @brief Create stream reading the source contents when writing the image.
+			/// @param source The source to read.
+			/// @param failures Counter for stream errors, any error invalidates the image.
+			static IsoStream * StreamFactory(std::shared_ptr<Source> source, std::shared_ptr<std::atomic<unsigned int>> failures);
+
+			/// @brief Was any local folder inserted as a whole?
+			bool grafted = false;
+
+			/// @brief Image directories by path.
+			std::unordered_map<std::string, IsoDir *> dirs;
+
+			/// @brief Get image directory, create it if necessary.
+			/// @param path The directory path, without leading or trailing '/'.
+			IsoDir * getIsoDir(const std::string &path);
+
+			/// @brief Get the image directory and file name for the source, remove grafted node on the same path.
+			void node(const Source &source, IsoDir **dir, const char **name);
+
+			/// @brief Get the image file with the same contents.
+			/// @param filename The local file to insert.
+			/// @return The name of the file already in the image with the same contents, or filename.
+			std::string shared(const char *filename);
+
 		protected:
 			bool apply(Source &source) override;
 
+			bool graft() const noexcept override;
+
+			bool lazy(const Source &source) const noexcept override;
+
 		public:
 
 			Builder();
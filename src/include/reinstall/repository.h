@@ -22,6 +22,9 @@
  #include <udjat/defs.h>
  #include <udjat/tools/object.h>
  #include <memory>
+ #include <mutex>
+ #include <string>
+ #include <vector>
  #include <pugixml.hpp>
 
  namespace Reinstall {
@@ -38,6 +41,9 @@
 			/// @brief Repository PATH on local harddisk from xml definition.
 			const char * local = "";
 
+			/// @brief Get files from local path when available, remote otherwise.
+			bool hybrid = false;
+
 			Path(const pugi::xml_node &node);
 
 		} path;
@@ -89,14 +95,48 @@
 
 		} slp;
 
+		/// @brief Mirror selection.
+		struct Mirrors {
+
+			/// @brief Probe mirrors and use the fastest one?
+			bool enabled = false;
+
+			/// @brief Path of the file used to measure the throughput (relative to the repository URL).
+			const char *probe = "";
+
+			/// @brief Mirror URLs from XML definition.
+			std::vector<std::string> candidates;
+
+			std::mutex guard;
+
+			/// @brief Was the probe pass done?
+			bool probed = false;
+
+			/// @brief Repository URL used when probing.
+			std::string base;
+
+			/// @brief URL of the fastest mirror (empty if none).
+			std::string selected;
+
+			Mirrors(const pugi::xml_node &node);
+
+		} mirrors;
+
+		/// @brief Probe mirrors, select the fastest one.
+		void select_mirror();
+
 	public:
 
 		/// @brief Repository layout.
 		const enum Layout : uint8_t {
 			ApacheLayout,		///< @brief Repository is a standard apache directory.
 			MirrorCacheLayout,	///< @brief It's a MirrorCache repository;
+			ManifestLayout,		///< @brief The file list is read from a manifest file.
 		} layout;
 
+		/// @brief Manifest file name (relative to the repository URL) for the manifest layout.
+		const char *manifest = "";
+
 		typedef struct {
 			bool operator() (const std::shared_ptr<Repository> a, const std::shared_ptr<Repository> b) const {
 				return strcasecmp(a->name(),b->name()) == 0;
@@ -117,6 +157,19 @@
 		/// @param Repository URL.
 		const std::string get_url(bool expand = false);
 
+		/// @brief Route URL to the fastest mirror.
+		/// @param url The URL to route.
+		/// @return The URL on the selected mirror or the original one if not under this repository or mirror selection is disabled.
+		std::string mirror(const char *url);
+
+		/// @brief Get the local copy of a repository file (hybrid repositories only).
+		/// @param url The file URL on the remote repository.
+		/// @param length The expected file length, if 0 it's asked to the server and updated.
+		/// @param sha256 The expected file digest (empty if unknown).
+		/// @param verified Set to true if the local copy was checked against the digest.
+		/// @return The URL of the local copy or an empty string if not available.
+		std::string local(const char *url, unsigned long long &length, const char *sha256, bool &verified);
+
 		/// @brief Get repository kernel parameter.
 		std::string get_kernel_parameter();
 
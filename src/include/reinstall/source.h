@@ -26,17 +26,40 @@
  #include <pugixml.hpp>
  #include <memory>
  #include <vector>
+ #include <functional>
+ #include <reinstall/checksum.h>
+ #include <sys/types.h>
 
  namespace Reinstall {
 
 	/// @brief File/Folder to copy from repository to image.
-	class UDJAT_API Source : public Udjat::NamedObject {
+	class UDJAT_API Source : public Udjat::NamedObject, public std::enable_shared_from_this<Source> {
 	protected:
 		struct {
 			std::string temp;			///< @brief If not empty, the temporary file name.
 			std::string saved;			///< @brief The filename used to download.
 		} filenames;
 
+		/// @brief The shared transfer of the URL contents (keeps the saved file).
+		std::shared_ptr<void> transfer;
+
+		struct {
+			std::shared_ptr<const std::string> contents;	///< @brief If not empty, the source contents.
+			mode_t mode = 0644;							///< @brief The file mode for the contents.
+		} memory;
+
+		/// @brief Write in-memory contents to file.
+		void write(const char *filename) const;
+
+		/// @brief Download URL contents to file.
+		/// @param filename The target filename.
+		/// @param persistent If true the filename is stable between runs, keep partial data for resume.
+		void download(const char *filename, bool persistent = false);
+
+		/// @brief Run a transfer, retry it from the repository if it fails on the mirror.
+		/// @param call The transfer, called with the URL to get.
+		void fetch(const std::function<void(const char *url)> &call);
+
 	public:
 
 		enum Type {
@@ -47,9 +70,20 @@
 		} type = Common;
 
 		const char *url = nullptr;			///< @brief The file URL.
+		const char *origin = "";			///< @brief The repository URL if routed to a mirror (empty if not).
 		const char *repository = nullptr;	///< @brief Repository name.
 		const char *path = nullptr;			///< @brief The path inside the image.
 		const char *message = nullptr;		///< @brief User message while downloading source.
+		bool cache = false;					///< @brief Keep a copy in the download cache?
+		bool listings = true;				///< @brief Use cached directory listings? (false if cache="no").
+		bool verified = false;				///< @brief The contents were already checked against the digest.
+		unsigned long long length = 0;		///< @brief File length from the directory listing (0 if unknown).
+		time_t mtime = 0;					///< @brief File modification time from the directory listing (0 if unknown).
+
+		struct {
+			const char *sha256 = "";		///< @brief Expected SHA-256 digest.
+			const char *url = "";			///< @brief URL of a sha256sum file with the expected digest.
+		} checksum;
 
 #ifndef _WIN32
 		/// @brief Extract mountpoint from path.
@@ -72,18 +106,60 @@
 		virtual ~Source();
 
 		inline bool saved() const noexcept {
-			return !filenames.saved.empty();
+			return !filenames.saved.empty() || memory.contents;
+		}
+
+		/// @brief Get in-memory contents.
+		/// @return The source contents, nullptr if the source is not in memory.
+		inline const std::string * contents() const noexcept {
+			return memory.contents.get();
 		}
 
+		/// @brief Get the file mode for in-memory contents.
+		inline mode_t mode() const noexcept {
+			return memory.mode;
+		}
+
+		/// @brief Route URL to the local copy of an hybrid repository or to the fastest mirror.
+		/// @param repository The source repository.
+		void route(Repository &repository);
+
+		/// @brief Get verifier for source contents.
+		/// @return The checksum verifier, nullptr if the source has no checksum.
+		std::shared_ptr<Checksum> ChecksumFactory() const;
+
+		/// @brief Check if the source is a local folder to insert as a whole.
+		bool folder() const noexcept;
+
+		/// @brief Check if the source requires a download.
+		/// @return true if the source is a remote file not yet saved.
+		virtual bool remote() const noexcept;
+
 		const char *filename(bool rw = false);
 
 		/// @brief Get path relative to partition.
 		const char * rpath() const;
 
 		inline void set_filename(const char *filename) noexcept {
+			memory.contents.reset();
 			filenames.saved = filename;
 		}
 
+		/// @brief Use in-memory contents.
+		/// @param contents The source contents.
+		/// @param mode The file mode for the contents.
+		inline void set_contents(std::shared_ptr<const std::string> contents, mode_t mode = 0644) noexcept {
+			filenames.saved.clear();
+			memory.contents = contents;
+			memory.mode = mode;
+			length = contents->size();
+		}
+
+		/// @brief Use the in-memory contents of another source.
+		inline void set_contents(const Source &source) noexcept {
+			set_contents(source.memory.contents,source.memory.mode);
+		}
+
 		inline bool operator< (const Source &b) const noexcept {
 			return strcasecmp(path,b.path) < 0;
 		}
@@ -105,7 +181,7 @@
 		void set(const Reinstall::Action &object);
 
 		/// @brief Download to temporary file.
-		void save();
+		virtual void save();
 
 		/// @brief Download to defined file.
 		virtual void save(const char *filename);
@@ -22,11 +22,26 @@
  #include <udjat/defs.h>
  #include <reinstall/source.h>
  #include <pugixml.hpp>
+ #include <string>
+ #include <vector>
 
  namespace Reinstall {
 
 	/// @brief The source for the installation kernel;
 	class UDJAT_API ZipFile : public Source {
+	private:
+
+		/// @brief Patterns for the entries to extract (all if empty).
+		std::vector<std::string> include;
+
+		/// @brief Patterns for the entries to ignore.
+		std::vector<std::string> exclude;
+
+		/// @brief Check the include/exclude patterns.
+		/// @param name The entry name.
+		/// @return true if the entry should be extracted.
+		bool selected(const char *name) const noexcept;
+
 	public:
 		ZipFile(const pugi::xml_node &node);
 
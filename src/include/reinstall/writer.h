@@ -24,6 +24,7 @@
  #include <reinstall/action.h>
  #include <reinstall/diskimage.h>
  #include <string>
+ #include <functional>
 
  namespace Reinstall {
 
@@ -72,6 +73,17 @@
 		/// @brief Write data to device.
 		virtual void write(const void *buf, size_t count);
 
+		/// @brief Write image using a reader and a writer thread over large buffers.
+		/// @param length The image length (0 if unknown).
+		/// @param read Fill buffer with image data, return the number of bytes (0 on the end of image).
+		/// @return The number of bytes written.
+		unsigned long long burn(unsigned long long length, const std::function<size_t(void *buf, size_t length)> &read);
+
+		/// @brief Write image file.
+		/// @param fd The image file, read from the start.
+		/// @return The number of bytes written.
+		unsigned long long burn(int fd);
+
 		virtual void finalize();
 
 		/// @brief Close Device.
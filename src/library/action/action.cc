@@ -30,6 +30,14 @@
  #include <udjat/tools/intl.h>
  #include <udjat/tools/configuration.h>
  #include <reinstall/sources/zipfile.h>
+ #include <private/scheduler.h>
+ #include <private/workqueue.h>
+ #include <private/meter.h>
+ #include <unordered_map>
+ #include <vector>
+ #include <cctype>
+ #include <unistd.h>
+ #include <algorithm>
 
  using namespace std;
  using namespace Udjat;
@@ -281,6 +289,100 @@
 		return true;
 	}
 
+	/// @brief Check if the source will be replaced by a template.
+	static bool replaced(const std::list<std::shared_ptr<Action::Template>> &templates, const Source &source) {
+		for(auto tmpl : templates) {
+			if(tmpl->test(source.path)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// @brief Replace sources with the same digest by aliases of the first one.
+	/// @param templates The action templates.
+	/// @param builder The image builder.
+	/// @param sources The action sources, duplicates are removed.
+	/// @param aliases The aliases for every remaining source.
+	/// @return The number of removed sources.
+	static size_t dedup(const std::list<std::shared_ptr<Action::Template>> &templates, const Builder &builder, std::list<std::shared_ptr<Source>> &sources, std::unordered_map<const Source *,std::vector<std::shared_ptr<Source>>> &aliases) {
+
+		std::unordered_map<std::string,std::shared_ptr<Source>> primaries;
+		size_t count = 0;
+
+		for(auto it = sources.begin(); it != sources.end();) {
+
+			std::shared_ptr<Source> source = *it;
+
+			// Sources streamed when writing the image have no file or buffer to share with the aliases.
+			if(!(source->checksum.sha256 && *source->checksum.sha256) || replaced(templates,*source) || builder.lazy(*source)) {
+				it++;
+				continue;
+			}
+
+			std::string digest{source->checksum.sha256};
+			for(char &chr : digest) {
+				chr = tolower(chr);
+			}
+
+			auto primary = primaries.find(digest);
+			if(primary == primaries.end()) {
+				primaries[digest] = source;
+				it++;
+				continue;
+			}
+
+			// Same contents, use the primary URL; the prefetching source (if any) is dropped.
+			auto alias = make_shared<Source>(source->name(),primary->second->url,source->path);
+			alias->length = source->length;
+			aliases[primary->second.get()].push_back(alias);
+
+			Logger::String{"'",source->path,"' has the same contents of '",primary->second->path,"'"}.trace(source->name());
+
+			it = sources.erase(it);
+			count++;
+
+		}
+
+		if(count) {
+			Logger::String{count," duplicated file(s) will be downloaded only once"}.info("action");
+		}
+
+		return count;
+
+	}
+
+	/// @brief Set a loading state while in scope, restore it on every exit path.
+	template <typename T>
+	class UDJAT_PRIVATE Restore {
+	private:
+		T &value;
+		T saved;
+
+	public:
+		Restore(T &v, T current) : value{v}, saved{v} {
+			value = current;
+		}
+
+		~Restore() {
+			value = saved;
+		}
+
+	};
+
+	void Action::prefetch(std::shared_ptr<Source> source) const {
+
+		if(!scheduler) {
+			return;
+		}
+
+		// Sources without length are measured before the download, dont share them with the workers now.
+		if(source->length && !replaced(templates,*source) && !(target && target->lazy(*source))) {
+			scheduler->prefetch(source);
+		}
+
+	}
+
 	void Action::load() {
 
 		Dialog::Progress &progress = Dialog::Progress::getInstance();
@@ -294,39 +396,64 @@
 		/// @brief List of expanded sources.
 		std::unordered_set<std::shared_ptr<Source>, Source::Hash, Source::Equal> expanded;
 
-		for(auto iter = sources.begin(); iter != sources.end();) {
-
-			std::shared_ptr<Source> source = *iter;
-			std::vector<std::shared_ptr<Source>> contents;
+		/// @brief Expanded sources in load order.
+		std::vector<std::shared_ptr<Source>> ordered;
 
-			iter = sources.erase(iter);	// Remove it; path can change.
+		// Set all sources; path can change.
+		std::vector<std::shared_ptr<Source>> pending{sources.begin(),sources.end()};
+		sources.clear();
 
+		for(std::shared_ptr<Source> source : pending) {
 			progress.pulse();
 			source->set(*this);
+		}
+
+		// Get folder contents in parallel, each source has its own result vector.
+		std::vector<std::vector<std::shared_ptr<Source>>> results(pending.size());
+		{
+			WorkQueue queue;
+			WorkQueue::Group group;
 
-			if(!source->contents(*this,contents)) {
-				contents.push_back(source);
+			for(size_t ix = 0; ix < pending.size(); ix++) {
+				queue.push(group,[this,&pending,&results,ix](){
+					if(!pending[ix]->contents(*this,results[ix])) {
+						results[ix].push_back(pending[ix]);
+					}
+				});
 			}
 
+			queue.wait(group);
+		}
+
+		// Merge in the source order, the first one wins on duplicates.
+		for(size_t ix = 0; ix < pending.size(); ix++) {
+
+			std::shared_ptr<Source> source = pending[ix];
+			std::vector<std::shared_ptr<Source>> &contents = results[ix];
+
+			progress.pulse();
+
 			Logger::String {
 				"Source '", source->name(), "' has ", contents.size(), " file(s)"
 			}.trace(name());
 
 			// Add expanded elements.
 			for(std::shared_ptr<Source> source : contents) {
-				if(expanded.count(source)) {
+				if(source->folder()) {
+					// Local folder inserted as a whole, the builder handles the overlapping files.
+					ordered.push_back(source);
+				} else if(expanded.count(source)) {
 					Logger::String{"Duplicate file '",source->path,"' on source ",source->name()}.trace(name());
 				} else {
 					expanded.insert(source);
+					ordered.push_back(source);
 				}
 			}
 
 		}
 
-		debug("-------------------------------> ", sources.size());
-
 		// Apply expanded list on sources.
-		for(std::shared_ptr<Source> source : expanded) {
+		for(std::shared_ptr<Source> source : ordered) {
 			sources.push_back(source);
 		}
 
@@ -342,6 +469,34 @@
 			}
 
 		}
+
+		// Search on local folders.
+		for(auto folder : sources) {
+
+			if(!folder->folder()) {
+				continue;
+			}
+
+			std::string prefix{folder->path};
+			if(prefix.empty() || prefix[prefix.size()-1] != '/') {
+				prefix += '/';
+			}
+
+			if(strncmp(path,prefix.c_str(),prefix.size())) {
+				continue;
+			}
+
+			std::string filename{folder->url+7};
+			filename += (path + prefix.size());
+
+			if(access(filename.c_str(),R_OK) == 0) {
+				auto source = make_shared<Source>(folder->name(),Quark{string{"file://"}+filename}.c_str(),Quark{path}.c_str());
+				source->set_filename(Quark{filename}.c_str());
+				return source;
+			}
+
+		}
+
 		error() << "Cant find source for path '" << path << "'" << endl;
 		throw system_error(ENOENT,system_category(),path);
 	}
@@ -479,9 +634,25 @@
 		auto builder = BuilderFactory();
 		builder->pre(*this);
 
-		// Get folder contents.
+		// Get folder contents, start downloads as soon as the files are listed.
+		Scheduler scheduler;
+		Meter &meter = Meter::getInstance();
+		meter.start();
+
+		// The builder decides which sources are downloaded, keep it until leaving.
+		Restore<const Builder *> building{this->target,builder.get()};
+
 		dialog.set_sub_title(_("Getting file lists"));
-		load();
+		{
+			Restore<Scheduler *> prefetching{this->scheduler,&scheduler};
+
+			// Templates replacing files by name need every file as a source.
+			Restore<bool> folders{grafting,builder->graft() && Config::Value<bool>("iso9660","graft",true) && std::all_of(templates.begin(),templates.end(),[](const std::shared_ptr<Template> &tmpl){
+				return tmpl->get_path() && *tmpl->get_path();
+			})};
+
+			load();
+		}
 
 		// Apply templates.
 		info() << "Applying " << templates.size() << " template(s)" << endl;
@@ -508,12 +679,13 @@
 					Udjat::String str{path};
 					str.expand(*this);
 
-					debug("Template=",tmpl->c_str()," filename=",tmpl->get_filename());
+					debug("Template=",tmpl->c_str());
 					auto source = make_shared<Source>(
 							tmpl->c_str(),
-							(string{"file://"} + tmpl->get_filename()).c_str(),
+							tmpl->get_url(),
 							str.c_str()
 					);
+					tmpl->apply(*source);
 
 					sources.remove_if([source](std::shared_ptr<Source> src){
 						return strcasecmp(source->path,src->path) == 0;
@@ -526,18 +698,49 @@
 
 		}
 
+		// Download files with the same contents only once.
+		std::unordered_map<const Source *,std::vector<std::shared_ptr<Source>>> aliases;
+		size_t duplicates = dedup(templates,*builder,sources,aliases);
+
+		// Check sizes before downloading.
+		dialog.set_sub_title(_("Checking file sizes"));
+		unsigned long long bytes = measure();
+
 		// Download files.
 		dialog.set_sub_title(_("Getting required files"));
-		size_t total = source_count();
+		size_t total = source_count() + duplicates;
 		size_t current = 0;
 
 		info() << "Getting " << total << " required files" << endl;
-		for_each([this,&current,total,&dialog,builder](Source &source) {
-			dialog.set_count(++current,total);
+		for(auto source : sources) {
+			// Sources read by the builder when writing the image are not downloaded now.
+			scheduler.push_back(source,!builder->lazy(*source));
+		}
+
+		meter.set_total(bytes,total);
+		scheduler.for_each([this,&current,total,&meter,&aliases,builder](Source &source) {
+
+			meter.set_count(++current);
 			Logger::String(source.url," (",current,"/",total,")").trace(source.name());
 			builder->apply(source);
+
+			// Apply the files with the same contents using the downloaded one.
+			auto it = aliases.find(&source);
+			if(it != aliases.end()) {
+				for(auto alias : it->second) {
+					if(source.contents()) {
+						alias->set_contents(source);
+					} else if(source.saved()) {
+						alias->set_filename(source.filename());
+					}
+					meter.set_count(++current);
+					Logger::String(alias->path," (",current,"/",total,")").trace(alias->name());
+					builder->apply(*alias);
+				}
+			}
+
 		});
-		dialog.set_count(0,0);
+		meter.stop();
 
 		info() << "Calling 'build' methods" << endl;
 		dialog.set_sub_title(_("Building"));
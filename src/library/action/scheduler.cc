@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/scheduler.h>
+ #include <private/meter.h>
+ #include <reinstall/source.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <chrono>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	unsigned int Scheduler::workers() {
+		return Config::Value<unsigned int>("download","workers",4);
+	}
+
+	Scheduler::Scheduler(unsigned int w) : limit{w ? w : workers()} {
+	}
+
+	Scheduler::~Scheduler() {
+		stop();
+	}
+
+	void Scheduler::stop() noexcept {
+
+		{
+			lock_guard<mutex> lock(guard);
+			cancelled = true;
+		}
+		changed.notify_all();
+
+		for(auto &thread : threads) {
+			if(thread.joinable()) {
+				thread.join();
+			}
+		}
+		threads.clear();
+
+	}
+
+	void Scheduler::start(size_t count) {
+
+		// Called with the guard locked.
+		count = std::min(count,(size_t) limit);
+		while(threads.size() < count) {
+			threads.emplace_back([this](){
+				worker();
+			});
+		}
+
+	}
+
+	void Scheduler::prefetch(std::shared_ptr<Source> source) {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			if(limit < 2 || !open || cancelled || !source->remote() || queued.count(source.get()) || busy.count(source.get())) {
+				return;
+			}
+
+			pending.push_back(source);
+			queued.insert(source.get());
+			start(busy.size() + pending.size());
+		}
+		changed.notify_one();
+
+	}
+
+	void Scheduler::push_back(std::shared_ptr<Source> source, bool download) {
+
+		lock_guard<mutex> lock(guard);
+
+		requested++;
+
+		if(queued.count(source.get()) || busy.count(source.get())) {
+			// Already prefetching, deliver when complete.
+			wanted.insert(source.get());
+		} else if(download && limit > 1 && source->remote()) {
+			pending.push_back(source);
+			queued.insert(source.get());
+			wanted.insert(source.get());
+		} else {
+			ready.push_back(source);
+		}
+
+	}
+
+	void Scheduler::worker() {
+
+		// Dont touch the progress dialog from this thread.
+		Meter::Background background;
+
+		while(true) {
+
+			std::shared_ptr<Source> source;
+
+			{
+				unique_lock<mutex> lock(guard);
+				changed.wait(lock,[this]{
+					return cancelled || !pending.empty() || !open;
+				});
+
+				if(cancelled || pending.empty()) {
+					return;
+				}
+
+				source = pending.front();
+				pending.pop_front();
+				queued.erase(source.get());
+				busy.insert(source.get());
+			}
+
+			try {
+
+				source->save();
+
+			} catch(...) {
+
+				lock_guard<mutex> lock(guard);
+				busy.erase(source.get());
+
+				if(!wanted.count(source.get())) {
+					// Just a prefetch, the source will be downloaded again if required.
+					Logger::String{"Prefetch of '",source->url,"' has failed"}.warning(source->name());
+					continue;
+				}
+
+				Logger::String{"Download of '",source->url,"' has failed"}.error(source->name());
+
+				if(!failed) {
+					failed = current_exception();
+				}
+				cancelled = true;
+				changed.notify_all();
+				return;
+
+			}
+
+			{
+				lock_guard<mutex> lock(guard);
+				busy.erase(source.get());
+				if(wanted.erase(source.get())) {
+					ready.push_back(source);
+				}
+			}
+			changed.notify_all();
+
+		}
+
+	}
+
+	void Scheduler::for_each(const std::function<void(Source &source)> &apply) {
+
+		size_t remaining;
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			open = false;
+
+			// Drop prefetches not required anymore.
+			pending.remove_if([this](const std::shared_ptr<Source> &source){
+				if(wanted.count(source.get())) {
+					return false;
+				}
+				queued.erase(source.get());
+				return true;
+			});
+
+			remaining = requested;
+
+			if(!pending.empty()) {
+				Logger::String{"Starting ",std::min((size_t) limit, pending.size())," download worker(s) for ",pending.size()," file(s)"}.trace("scheduler");
+			}
+
+			start(pending.size());
+		}
+		changed.notify_all();
+
+		try {
+
+			while(remaining) {
+
+				std::shared_ptr<Source> source;
+
+				{
+					unique_lock<mutex> lock(guard);
+					while(!(failed || !ready.empty())) {
+
+						// Show the progress of the background downloads.
+						if(changed.wait_for(lock,std::chrono::milliseconds(250)) == std::cv_status::timeout) {
+							lock.unlock();
+							Meter::getInstance().update();
+							lock.lock();
+						}
+
+					}
+
+					if(failed) {
+						rethrow_exception(failed);
+					}
+
+					source = ready.front();
+					ready.pop_front();
+				}
+
+				apply(*source);
+				remaining--;
+
+			}
+
+		} catch(...) {
+
+			stop();
+			throw;
+
+		}
+
+		stop();
+
+	}
+
+ }
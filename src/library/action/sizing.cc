@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/action.h>
+ #include <reinstall/source.h>
+ #include <reinstall/builder.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <udjat/tools/file.h>
+ #include <private/workqueue.h>
+ #include <private/cache.h>
+ #include <private/meter.h>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <sys/statvfs.h>
+ #include <vector>
+ #include <atomic>
+ #include <cstdio>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	unsigned long long Action::capacity() const noexcept {
+		return 0;
+	}
+
+	static inline bool is_http(const char *url) {
+		return strncasecmp(url,"http://",7) == 0 || strncasecmp(url,"https://",8) == 0;
+	}
+
+	unsigned long long Action::measure() {
+
+		// Get the lengths not available from the listings.
+		// Only sources without length are updated, they are not prefetched (see Action::prefetch).
+		{
+			std::vector<std::shared_ptr<Source>> unknown;
+
+			for(auto source : sources) {
+
+				if(source->length) {
+					continue;
+				}
+
+				if(strncasecmp(source->url,"file://",7) == 0) {
+
+					struct stat st;
+					if(stat(source->url+7,&st) == 0 && S_ISREG(st.st_mode)) {
+						source->length = st.st_size;
+					}
+
+				} else if(is_http(source->url)) {
+
+					unknown.push_back(source);
+
+				}
+
+			}
+
+			if(!unknown.empty()) {
+
+				Logger::String{"Getting length of ",unknown.size()," file(s)"}.trace(name());
+
+				WorkQueue queue;
+				WorkQueue::Group group;
+
+				for(auto source : unknown) {
+					queue.push(group,[source](){
+						try {
+							source->length = Cache::Validators{source->url}.length;
+						} catch(const std::exception &e) {
+							Logger::String{"Cant get length of '",source->url,"': ",e.what()}.trace(source->name());
+						}
+					});
+				}
+
+				queue.wait(group);
+
+			}
+
+		}
+
+		// Get totals.
+		unsigned long long contents = 0;		// All sources.
+		unsigned long long download = 0;		// Remote sources.
+		unsigned long long temporary = 0;		// Remote sources saved as temporary files.
+		size_t unknown = 0;
+
+		for(auto source : sources) {
+
+			if(!source->length && strncasecmp(source->url,"zip://",6)) {
+				unknown++;
+			}
+
+			contents += source->length;
+
+			if(is_http(source->url) && !(target && target->lazy(*source))) {
+
+				// Streamed sources are read when writing the image, cached ones are just revalidated.
+				if(source->cache && Cache::getInstance().contains(source->url)) {
+					continue;
+				}
+
+				download += source->length;
+				if(!source->cache) {
+					temporary += source->length;
+				}
+
+			}
+
+		}
+
+		Logger::String{
+			"Sources: ",Meter::format(contents)," (",Meter::format(download)," to download, ",unknown," file(s) with unknown length)"
+		}.info(name());
+
+		// Check image capacity.
+		unsigned long long available = capacity();
+		if(available && contents > available) {
+			throw runtime_error(
+				Logger::Message(
+					_("The files ({}) doesn't fit on the image ({})"),
+					Meter::format(contents),
+					Meter::format(available)
+				)
+			);
+		}
+
+		// Check temporary space.
+		if(temporary) {
+
+			std::string tempname{File::Temporary::create()};
+			remove(tempname.c_str());
+
+			auto pos = tempname.rfind('/');
+			std::string dirname{pos == string::npos ? "." : tempname.substr(0,pos+1)};
+
+			struct statvfs st;
+			if(statvfs(dirname.c_str(),&st) == 0) {
+
+				unsigned long long free = ((unsigned long long) st.f_bavail) * st.f_frsize;
+				if(temporary > free) {
+					throw runtime_error(
+						Logger::Message(
+							_("Not enough space on {} to download the files ({} required, {} available)"),
+							dirname,
+							Meter::format(temporary),
+							Meter::format(free)
+						)
+					);
+				}
+
+			}
+
+		}
+
+		return download;
+
+	}
+
+ }
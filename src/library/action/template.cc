@@ -25,10 +25,16 @@
  #include <reinstall/dialogs.h>
  #include <udjat/tools/file.h>
  #include <iostream>
+ #include <fstream>
+ #include <sstream>
+ #include <private/cache.h>
+ #include <private/singleflight.h>
  #include <sys/types.h>
  #include <sys/stat.h>
  #include <fcntl.h>
  #include <unistd.h>
+ #include <mutex>
+ #include <unordered_map>
  #include <udjat/tools/intl.h>
  #include <udjat/tools/logger.h>
  #include <udjat/tools/configuration.h>
@@ -46,6 +52,7 @@
 		} {
 
 		script = node.attribute("script").as_bool(script);
+		cache = node.attribute("cache").as_bool(Config::Value<bool>("cache","default",false));
 		const char *sMarker = node.attribute("marker").as_string(((std::string) Config::Value<String>("template","marker","$")).c_str());
 
 		if(strlen(sMarker) > 1 || !sMarker[0]) {
@@ -57,17 +64,19 @@
 	}
 
 	Action::Template::~Template() {
-		if(!filename.empty()) {
-			if(remove(filename.c_str()) != 0) {
-				cerr << "tempfile\tError removing '" << filename << "'" << endl;
-			}
-		}
 	}
 
+	/// @brief Downloaded contents of remote templates, before expansion.
+	/// @details Kept for the session, actions using the same template URL get it only once.
+	static struct {
+		std::mutex guard;
+		std::unordered_map<std::string,std::shared_ptr<const std::string>> contents;
+	} downloaded;
+
 	void Action::Template::load(const Udjat::Object &object) {
 
-		if(!filename.empty()) {
-			debug("Template already saved on '",filename,"'");
+		if(contents) {
+			debug("Template already loaded");
 			return;
 		}
 
@@ -75,36 +84,94 @@
 		auto worker = Udjat::Protocol::WorkerFactory(String{this->url}.expand(object).c_str());
 
 		progress.set_url(worker->url().c_str());
-		Udjat::String contents = worker->get([&progress](double current, double total){
-			progress.set_progress(current,total);
-			return true;
-		});
 
-		// Expand ${} values using object.
-		contents.expand(marker,object,true,true);
+		Udjat::String text;
+
+		if(strncasecmp(worker->url().c_str(),"file://",7)) {
 
-		debug("Marker = '",string{marker},"' \n",contents,"\n");
+			std::shared_ptr<const std::string> raw;
+			{
+				std::lock_guard<std::mutex> lock(downloaded.guard);
+				auto it = downloaded.contents.find(worker->url());
+				if(it != downloaded.contents.end()) {
+					raw = it->second;
+				}
+			}
 
-		// Save to temporary.
-		debug("Saving template");
-		filename = Udjat::File::save(contents.c_str());
+			if(raw) {
 
-		{
-			mode_t mode = 0644;
+				Logger::String{"Using the previous download of '",worker->url().c_str(),"'"}.trace(name);
 
-			if(script) {
-				Logger::String{"Template is script, using exec permission"}.trace(name);
-				mode = 0755;
 			} else {
-				Logger::String{"Template is not script, using standard file permission"}.trace(name);
-				mode = 0644;
-			}
 
-			if(chmod(filename.c_str(),mode) < 0) {
-				throw system_error(errno,system_category(),_("Cant update template permissions"));
+				// Remote template, share the transfer with other actions loading it at the same time.
+				auto shared = SingleFlight::get(worker->url().c_str(),[this,&progress,worker](const char *tempname){
+
+					if(cache) {
+
+						// Get template from download cache.
+						std::string cached = Cache::getInstance().get(worker->url().c_str(),[&progress,worker](const char *filename){
+							worker->save(filename,[&progress](double current, double total){
+								progress.set_progress(current,total);
+								return true;
+							},true);
+						});
+
+						if(!cached.empty()) {
+							return cached;
+						}
+
+					}
+
+					worker->save(tempname,[&progress](double current, double total){
+						progress.set_progress(current,total);
+						return true;
+					},true);
+
+					return string{tempname};
+
+				});
+
+				// Keep the contents for the session, the transfer (and the file) is released now.
+				std::ifstream in{shared->filename};
+				std::stringstream stream;
+				stream << in.rdbuf();
+				if(in.bad()) {
+					throw system_error(errno,system_category(),shared->filename);
+				}
+
+				raw = make_shared<const std::string>(stream.str());
+
+				std::lock_guard<std::mutex> lock(downloaded.guard);
+				downloaded.contents.emplace(worker->url(),raw);
+
 			}
 
+			text = *raw;
+
+		} else {
+
+			text = worker->get([&progress](double current, double total){
+				progress.set_progress(current,total);
+				return true;
+			});
+
+		}
+
+		// Expand ${} values using object.
+		text.expand(marker,object,true,true);
+
+		debug("Marker = '",string{marker},"' \n",text,"\n");
+
+		// Keep it in memory, the builders will write it when required.
+		contents = make_shared<std::string>(text);
+
+		if(script) {
+			Logger::String{"Template is script, using exec permission"}.trace(name);
+		} else {
+			Logger::String{"Template is not script, using standard file permission"}.trace(name);
 		}
+
 	}
 
 	bool Action::Template::test(const char *isopath) const noexcept {
@@ -129,7 +196,7 @@
 
 	void Action::Template::replace(const char *path) const {
 
-		if(filename.empty()) {
+		if(!contents) {
 			throw runtime_error(_("Template was not loaded"));
 		}
 
@@ -137,7 +204,17 @@
 			"Saving template '", name, "' as '", path, "'"
 		}.info("template");
 
-		Udjat::File::copy(filename.c_str(),path);
+		{
+			std::ofstream out{path,std::ofstream::trunc|std::ofstream::binary};
+			out << *contents;
+			if(!out) {
+				throw system_error(errno,system_category(),path);
+			}
+		}
+
+		if(chmod(path,script ? 0755 : 0644) < 0) {
+			throw system_error(errno,system_category(),_("Cant update template permissions"));
+		}
 
 	}
 
@@ -147,7 +224,11 @@
 			"Replacing file '", source.path, "' with '", name, "' template"
 		}.trace("template");
 
-		source.set_filename(this->filename.c_str());
+		if(!contents) {
+			throw runtime_error(_("Template was not loaded"));
+		}
+
+		source.set_contents(contents,script ? 0755 : 0644);
 
 	}
 
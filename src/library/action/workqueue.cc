@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/workqueue.h>
+ #include <private/meter.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	static thread_local WorkQueue *active = nullptr;
+
+	unsigned int WorkQueue::workers() {
+		return Config::Value<unsigned int>("download","expand-workers",8);
+	}
+
+	WorkQueue * WorkQueue::current() noexcept {
+		return active;
+	}
+
+	WorkQueue::WorkQueue(unsigned int w) : limit{w ? w : workers()} {
+	}
+
+	WorkQueue::~WorkQueue() {
+
+		{
+			lock_guard<mutex> lock(guard);
+			stopping = true;
+		}
+		changed.notify_all();
+
+		for(auto &thread : threads) {
+			thread.join();
+		}
+
+	}
+
+	void WorkQueue::run(Task &task) noexcept {
+
+		std::exception_ptr failed;
+
+		try {
+			task.call();
+		} catch(...) {
+			failed = current_exception();
+		}
+
+		{
+			lock_guard<mutex> lock(guard);
+			if(failed && !task.group->failed) {
+				task.group->failed = failed;
+			}
+			task.group->pending--;
+		}
+		changed.notify_all();
+
+	}
+
+	void WorkQueue::worker() {
+
+		active = this;
+		Meter::Background background;
+
+		while(true) {
+
+			Task task;
+
+			{
+				unique_lock<mutex> lock(guard);
+				changed.wait(lock,[this]{
+					return stopping || !tasks.empty();
+				});
+
+				if(tasks.empty()) {
+					return;
+				}
+
+				task = tasks.front();
+				tasks.pop_front();
+			}
+
+			run(task);
+
+		}
+
+	}
+
+	void WorkQueue::push(Group &group, const std::function<void()> &task) {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			tasks.push_back(Task{&group,task});
+			group.pending++;
+
+			// The thread calling wait() runs tasks too.
+			if(threads.size() + 1 < limit && threads.size() < tasks.size()) {
+				threads.emplace_back([this](){
+					worker();
+				});
+			}
+		}
+		changed.notify_one();
+
+	}
+
+	void WorkQueue::wait(Group &group) {
+
+		WorkQueue *saved = active;
+		active = this;
+
+		while(true) {
+
+			Task task;
+
+			{
+				unique_lock<mutex> lock(guard);
+				changed.wait(lock,[this,&group]{
+					return !group.pending || !tasks.empty();
+				});
+
+				if(!group.pending) {
+					break;
+				}
+
+				task = tasks.front();
+				tasks.pop_front();
+			}
+
+			run(task);
+
+		}
+
+		active = saved;
+
+		if(group.failed) {
+			rethrow_exception(group.failed);
+		}
+
+	}
+
+ }
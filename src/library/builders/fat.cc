@@ -204,10 +204,7 @@
 				progress.set_sub_title(_("Writing image"));
 
 				writer->open();
-				File::Handler::save([&progress,writer](unsigned long long current, unsigned long long total, const void *buf, size_t length) {
-					progress.set_progress(current,total);
-					writer->write(buf, length);
-				});
+				writer->burn(fd);
 
 				progress.set_sub_title(_("Finalizing"));
 				writer->finalize();
@@ -223,6 +220,10 @@
 		return make_shared<Builder>(*this);
 	}
 
+	unsigned long long FatBuilder::capacity() const noexcept {
+		return imglen;
+	}
+
 	std::shared_ptr<Reinstall::Writer> FatBuilder::WriterFactory() {
 		return Reinstall::Writer::USBWriterFactory(*this);
 	}
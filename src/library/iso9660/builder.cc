@@ -28,9 +28,11 @@
  #include <udjat/tools/intl.h>
  #include <udjat/tools/logger.h>
  #include <udjat/tools/url.h>
+ #include <reinstall/checksum.h>
 
  #include <sys/stat.h>
  #include <fcntl.h>
+ #include <cstdlib>
 
  #ifndef _WIN32
 	#include <unistd.h>
@@ -78,6 +80,10 @@
 		iso_write_opts_set_relaxed_vol_atts(opts, 1);
 		iso_write_opts_set_rrip_version_1_10(opts,1);
 
+		dedup = Config::Value<bool>("iso9660","dedup",true);
+		streams = Config::Value<bool>("iso9660","lazy",false);
+		failures = make_shared<std::atomic<unsigned int>>(0);
+
 	}
 
 	iso9660::Builder::~Builder() {
@@ -85,37 +91,148 @@
 		iso_write_opts_free(opts);
 	}
 
-	static IsoDir * getIsoDir(IsoImage *image, const char *dirname) {
+	/// @brief Get directory path, without leading, trailing or repeated '/'.
+	static std::string dirname(const char *path, const char *end) {
+
+		std::string rc;
+		rc.reserve(end - path);
 
-		if(*dirname == '/') {
-			dirname++;
+		for(const char *ptr = path; ptr < end; ptr++) {
+			if(*ptr != '/' || (!rc.empty() && rc.back() != '/')) {
+				rc += *ptr;
+			}
 		}
 
-		int rc;
-		IsoDir * dir = iso_image_get_root(image);
+		if(!rc.empty() && rc.back() == '/') {
+			rc.pop_back();
+		}
 
-		for(auto dn : Udjat::String(dirname).split("/")) {
+		return rc;
 
-			IsoNode *node;
-			rc = iso_image_dir_get_node(image,dir,dn.c_str(),&node,0);
-			if(rc == 0) {
+	}
+
+	IsoDir * iso9660::Builder::getIsoDir(const std::string &path) {
 
-				// Not found, add it.
-				rc = iso_tree_add_new_dir(dir, dn.c_str(), (IsoDir **) &node);
+		if(path.empty()) {
+			return iso_image_get_root(image);
+		}
 
-			};
+		auto it = dirs.find(path);
+		if(it != dirs.end()) {
+			return it->second;
+		}
 
-			if(rc < 0) {
-				cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding path " << dirname << endl;
-				throw runtime_error(iso_error_to_msg(rc));
+		// Not known, get parent and search (or create) the directory on it.
+		IsoDir *parent;
+		const char *name;
+
+		auto pos = path.rfind('/');
+		if(pos == string::npos) {
+			parent = iso_image_get_root(image);
+			name = path.c_str();
+		} else {
+			parent = getIsoDir(path.substr(0,pos));
+			name = path.c_str() + pos + 1;
+		}
+
+		IsoNode *node;
+		int rc = iso_image_dir_get_node(image,parent,name,&node,0);
+		if(rc == 0) {
+
+			// Not found, add it.
+			rc = iso_tree_add_new_dir(parent, name, (IsoDir **) &node);
+
+		};
+
+		if(rc < 0) {
+			cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding path " << path << endl;
+			throw runtime_error(iso_error_to_msg(rc));
+		}
+
+		dirs[path] = (IsoDir *) node;
+		return (IsoDir *) node;
+
+	}
+
+	std::string iso9660::Builder::shared(const char *filename) {
+
+		struct stat st;
+		if(!dedup || stat(filename,&st) || !st.st_size) {
+			return filename;
+		}
+
+		// Only files with the same length can have the same contents, compare digests.
+		auto &files = stored[(unsigned long long) st.st_size];
+		std::string digest;
+
+		for(auto &file : files) {
+
+			if(file.filename == filename) {
+				return filename;
 			}
 
-			dir = (IsoDir *) node;
+			if(digest.empty()) {
+				digest = Checksum::compute(filename);
+			}
+
+			if(file.digest.empty()) {
+				file.digest = Checksum::compute(file.filename.c_str());
+			}
+
+			if(file.digest == digest) {
+				Logger::String{"'",filename,"' has the same contents of '",file.filename,"'"}.trace("iso9660");
+				return file.filename;
+			}
+
+		}
+
+		files.push_back(Stored{filename,digest});
+		return filename;
+
+	}
+
+	bool iso9660::Builder::graft() const noexcept {
+		return true;
+	}
+
+	void iso9660::Builder::node(const Source &source, IsoDir **dir, const char **name) {
+
+		auto pos = strrchr(source.path,'/');
+		if(pos) {
+
+			if(!*(pos+1)) {
+				cerr << "iso9660\tCan't insert node '" << source.path << "' it's not a FILE name, looks like a DIRECTORY name" << endl;
+				throw logic_error(_("Unexpanded path in source list"));
+			}
+
+			// Has path, get iso dir.
+			*dir = getIsoDir(dirname(source.path,pos));
+			*name = pos+1;
+
+		} else {
+
+			// No path, store on root.
+			*dir = iso_image_get_root(image);
+			*name = source.path;
+
+		}
+
+		if(grafted) {
+
+			// The file can be on a grafted folder, replace it.
+			IsoNode *node;
+			if(iso_image_dir_get_node(image,*dir,*name,&node,0) == 1) {
+				Logger::String{"Replacing grafted node '",source.path,"'"}.trace("iso9660");
+				iso_node_remove(node);
+			}
 
 		}
 
-		return dir;
+	}
 
+	bool iso9660::Builder::lazy(const Source &source) const noexcept {
+		// Only sources with known length and digest, the stream can't be retried and must be verified.
+		return streams && source.length && (*source.checksum.sha256 || *source.checksum.url) && !source.saved() && !source.folder() && strncasecmp(source.url,"file://",7);
 	}
 
 	bool iso9660::Builder::apply(Source &source) {
@@ -124,6 +241,91 @@
 			return false;
 		}
 
+		if(source.folder()) {
+
+			// Local folder, insert the whole tree.
+			std::string path{source.url+7};
+			IsoDir *dir = getIsoDir(dirname(source.path,source.path+strlen(source.path)));
+
+			Logger::String{"Grafting '",path,"' on '",source.path,"'"}.trace("iso9660");
+
+			int rc = iso_tree_add_dir_rec(image,dir,path.c_str());
+			if(rc < 0) {
+				cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding " << path << endl;
+				throw runtime_error(iso_error_to_msg(rc));
+			}
+
+			grafted = true;
+			return true;
+
+		}
+
+		if(source.contents()) {
+
+			// In memory, libisofs takes the ownership of the buffer.
+			const std::string *contents = source.contents();
+
+			void *buffer = malloc(contents->size() ? contents->size() : 1);
+			if(!buffer) {
+				throw bad_alloc();
+			}
+			memcpy(buffer,contents->data(),contents->size());
+
+			IsoStream *stream = NULL;
+			int rc = iso_memory_stream_new((unsigned char *) buffer,contents->size(),&stream);
+			if(rc < 0) {
+				free(buffer);
+				throw runtime_error(iso_error_to_msg(rc));
+			}
+
+			IsoDir *dir;
+			const char *name;
+			node(source,&dir,&name);
+
+			IsoFile *file = NULL;
+			rc = iso_tree_add_new_file(dir,name,stream,&file);
+			if(rc < 0) {
+				iso_stream_unref(stream);
+				cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding " << source.path << endl;
+				throw runtime_error(iso_error_to_msg(rc));
+			}
+
+			iso_node_set_permissions((IsoNode *) file,source.mode());
+
+			return true;
+
+		}
+
+		if(lazy(source)) {
+
+			// Read contents when writing the image.
+			std::shared_ptr<Source> shared;
+			try {
+				shared = source.shared_from_this();
+			} catch(const std::bad_weak_ptr &) {
+				shared.reset();
+			}
+
+			if(shared) {
+
+				IsoDir *dir;
+				const char *name;
+				node(source,&dir,&name);
+
+				IsoStream *stream = StreamFactory(shared,failures);
+				int rc = iso_tree_add_new_file(dir,name,stream,NULL);
+				if(rc < 0) {
+					iso_stream_unref(stream);
+					cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding " << source.path << endl;
+					throw runtime_error(iso_error_to_msg(rc));
+				}
+
+				return true;
+
+			}
+
+		}
+
 		// Download and save to temporary file.
 		if(strncasecmp(source.url,"file://",7)) {
 
@@ -151,35 +353,14 @@
 
 		int rc = 0;
 
-		auto pos = strrchr(source.path,'/');
-		if(pos) {
-
-			if(!*(pos+1)) {
-				cerr << "iso9660\tCan't insert node '" << source.path << "' it's not a FILE name, looks like a DIRECTORY name" << endl;
-				throw logic_error(_("Unexpanded path in source list"));
-			}
+		// Nodes from the same local file share the data blocks in the image.
+		std::string filename{shared(source.filename())};
 
-			// Has path, get iso dir.
-			rc = iso_tree_add_new_node(
-				image,
-				getIsoDir(image,string(source.path,pos - source.path).c_str()),
-				pos+1,
-				source.filename(),
-				NULL
-			);
+		IsoDir *dir;
+		const char *name;
+		node(source,&dir,&name);
 
-		} else {
-
-			// No path, store on root.
-			rc = iso_tree_add_new_node(
-				image,
-				iso_image_get_root(image),
-				source.path,
-				source.filename(),
-				NULL
-			);
-
-		}
+		rc = iso_tree_add_new_node(image,dir,name,filename.c_str(),NULL);
 
 		if(rc < 0) {
 			cerr << "iso9660\tError '" << iso_error_to_msg(rc) << "' adding node" << endl;
@@ -426,27 +607,31 @@
 		progress.set_sub_title(_("Writing image"));
 		try {
 
-			#define BUFLEN 2048
-			unsigned char buffer[BUFLEN];
+			writer->burn(burn_src->get_size(burn_src),[this,burn_src](void *buf, size_t length) -> size_t {
 
-			double current = 0;
-			double total = burn_src->get_size(burn_src);
+				// libisofs reads whole sectors, blocks are multiple of them.
+				int bytes = burn_src->read_xt(burn_src, (unsigned char *) buf, (int) length);
+				if(bytes < 0) {
+					throw runtime_error(_("Error reading iso image"));
+				}
 
-			while(burn_src->read_xt(burn_src, buffer, BUFLEN) == BUFLEN) {
+				if(*failures) {
+					// libisofs replaces unreadable data with zeros, the image is corrupted.
+					throw runtime_error(_("Error reading streamed file, the written image is not valid"));
+				}
 
-				writer->write(buffer,BUFLEN);
+				return (size_t) bytes;
 
-				current += BUFLEN;
-				if(total) {
-					progress.set_progress(current,total);
-				}
+			});
 
+			if(*failures) {
+				throw runtime_error(_("Error reading streamed file, the written image is not valid"));
 			}
 
-
 		} catch(...) {
 
 			burn_src->free_data(burn_src);
+			free(burn_src);
 			throw;
 
 		}
@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /**
+  * @brief Implements an iso stream reading the source contents when the image is written.
+  */
+
+ #include <config.h>
+ #include <reinstall/iso9660.h>
+ #include <reinstall/source.h>
+ #include <reinstall/action.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <private/meter.h>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <deque>
+ #include <vector>
+ #include <atomic>
+ #include <cstring>
+ #include <cstdlib>
+
+ #define LIBISOFS_WITHOUT_LIBBURN
+ #include <libisofs/libisofs.h>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Layout of libisofs 'struct iso_stream', it's not visible on C++.
+	struct UDJAT_PRIVATE StreamHandle {
+		IsoStreamIface *iface;
+		int refcount;
+		void *data;
+	};
+
+	/// @brief Stream contents, download the source on a thread while libisofs reads it.
+	class UDJAT_PRIVATE Stream {
+	private:
+		std::mutex guard;
+		std::condition_variable changed;
+		std::thread *producer = nullptr;
+
+		/// @brief Blocks received but not yet read.
+		std::deque<std::vector<uint8_t>> blocks;
+
+		/// @brief Offset of the first unread byte in the first block.
+		size_t offset = 0;
+
+		/// @brief Bytes waiting on blocks.
+		size_t buffered = 0;
+
+		bool finished = false;
+		bool cancel = false;
+		std::exception_ptr failed;
+
+		/// @brief Bytes already read.
+		unsigned long long current = 0;
+
+		/// @brief Bytes received from the source.
+		unsigned long long produced = 0;
+
+		/// @brief Report error, the image being written is not valid.
+		int error(const char *message) {
+			Logger::String{"Error streaming '",source->url,"': ",message}.error("iso9660");
+			(*failures)++;
+			return ISO_FILE_READ_ERROR;
+		}
+
+	public:
+		std::shared_ptr<Source> source;
+		std::shared_ptr<std::atomic<unsigned int>> failures;
+		ino_t ino;
+		size_t limit;
+
+		Stream(std::shared_ptr<Source> s, std::shared_ptr<std::atomic<unsigned int>> f, ino_t i) : source{s}, failures{f}, ino{i} {
+			limit = Action::getImageSize(Config::Value<string>("iso9660","stream-buffer","4MB").c_str());
+			if(limit < 65536) {
+				limit = 65536;
+			}
+		}
+
+		~Stream() {
+			close();
+		}
+
+		void open() {
+
+			close();
+
+			blocks.clear();
+			offset = buffered = 0;
+			finished = cancel = false;
+			failed = nullptr;
+			current = produced = 0;
+
+			Logger::String{"Streaming '",source->url,"' to '",source->path,"'"}.trace("iso9660");
+
+			producer = new std::thread([this](){
+
+				// The dialog belongs to the thread writing the image.
+				Meter::Background background;
+
+				try {
+
+					source->save([this](const void *buf, size_t length){
+
+						unique_lock<mutex> lock(guard);
+						changed.wait(lock,[this]{
+							return cancel || buffered < limit;
+						});
+
+						if(cancel) {
+							throw runtime_error("Stream was closed");
+						}
+
+						if(produced + length > source->length) {
+							throw runtime_error(Logger::Message(_("Received more than the expected {} bytes"),source->length));
+						}
+
+						produced += length;
+
+						blocks.emplace_back((const uint8_t *) buf,((const uint8_t *) buf)+length);
+						buffered += length;
+						changed.notify_all();
+
+					});
+
+				} catch(...) {
+
+					lock_guard<mutex> lock(guard);
+					if(!cancel) {
+						failed = current_exception();
+					}
+
+				}
+
+				{
+					lock_guard<mutex> lock(guard);
+					finished = true;
+				}
+				changed.notify_all();
+
+			});
+
+		}
+
+		void close() {
+
+			if(!producer) {
+				return;
+			}
+
+			{
+				lock_guard<mutex> lock(guard);
+				cancel = true;
+			}
+			changed.notify_all();
+
+			producer->join();
+			delete producer;
+			producer = nullptr;
+
+			blocks.clear();
+			buffered = 0;
+
+		}
+
+		int read(uint8_t *buf, size_t count) {
+
+			size_t bytes = 0;
+
+			unique_lock<mutex> lock(guard);
+
+			while(bytes < count) {
+
+				changed.wait(lock,[this]{
+					return finished || !blocks.empty();
+				});
+
+				if(blocks.empty()) {
+					// Producer has finished.
+					break;
+				}
+
+				std::vector<uint8_t> &block = blocks.front();
+				size_t length = std::min(count-bytes,block.size()-offset);
+				memcpy(buf+bytes,block.data()+offset,length);
+
+				bytes += length;
+				offset += length;
+				buffered -= length;
+
+				if(offset >= block.size()) {
+					blocks.pop_front();
+					offset = 0;
+				}
+
+				changed.notify_all();
+
+			}
+
+			current += bytes;
+
+			if(current >= source->length && !failed) {
+
+				// Got the expected length, wait for the end of the transfer to check the digest and the length.
+				changed.wait(lock,[this]{
+					return finished;
+				});
+
+				if(!failed && produced != source->length) {
+					return error(Logger::Message(_("Received {} bytes, expected {}"),produced,source->length).c_str());
+				}
+
+			}
+
+			if(failed) {
+				try {
+					rethrow_exception(failed);
+				} catch(const std::exception &e) {
+					return error(e.what());
+				} catch(...) {
+					return error("Unexpected error");
+				}
+			}
+
+			if(finished && blocks.empty() && current != source->length && bytes < count) {
+				return error(Logger::Message(_("Received {} bytes, expected {}"),current,source->length).c_str());
+			}
+
+			return (int) bytes;
+
+		}
+
+	};
+
+	/// @brief Filesystem id for the inodes, must not collide with the libisofs ones.
+	static const unsigned int stream_fs_id = 0x72696e73;
+
+	static Stream & stream_data(IsoStream *stream) {
+		return *((Stream *) ((StreamHandle *) stream)->data);
+	}
+
+	static int stream_open(IsoStream *stream) {
+		try {
+			stream_data(stream).open();
+		} catch(const std::exception &e) {
+			Logger::String{"Cant open stream: ",e.what()}.error("iso9660");
+			return ISO_FILE_ERROR;
+		}
+		return ISO_SUCCESS;
+	}
+
+	static int stream_close(IsoStream *stream) {
+		stream_data(stream).close();
+		return ISO_SUCCESS;
+	}
+
+	static off_t stream_get_size(IsoStream *stream) {
+		return (off_t) stream_data(stream).source->length;
+	}
+
+	static int stream_read(IsoStream *stream, void *buf, size_t count) {
+		return stream_data(stream).read((uint8_t *) buf, count);
+	}
+
+	static int stream_is_repeatable(IsoStream *) {
+		return 1;
+	}
+
+	static void stream_get_id(IsoStream *stream, unsigned int *fs_id, dev_t *dev_id, ino_t *ino_id) {
+		*fs_id = stream_fs_id;
+		*dev_id = 0;
+		*ino_id = stream_data(stream).ino;
+	}
+
+	static void stream_free(IsoStream *stream) {
+		delete &stream_data(stream);
+	}
+
+	static IsoStreamIface stream_class = {
+		0,
+		{ 'r', 'i', 'n', 's' },
+		stream_open,
+		stream_close,
+		stream_get_size,
+		stream_read,
+		stream_is_repeatable,
+		stream_get_id,
+		stream_free
+	};
+
+	IsoStream * iso9660::Builder::StreamFactory(std::shared_ptr<Source> source, std::shared_ptr<std::atomic<unsigned int>> failures) {
+
+		// Unique id for each stream, don't share blocks with other files.
+		static std::atomic<ino_t> inodes{0};
+
+		StreamHandle *handle = (StreamHandle *) malloc(sizeof(StreamHandle));
+		if(!handle) {
+			throw bad_alloc();
+		}
+
+		handle->iface = &stream_class;
+		handle->refcount = 1;
+		handle->data = new Stream(source,failures,++inodes);
+
+		return (IsoStream *) handle;
+
+	}
+
+ }
@@ -22,6 +22,7 @@
  #include <reinstall/defs.h>
  #include <reinstall/writer.h>
  #include <system_error>
+ #include <cstdint>
  #include <udjat/tools/intl.h>
  #include <unistd.h>
  #include <udjat/tools/logger.h>
@@ -34,9 +35,23 @@
  namespace Reinstall {
 
 	void Writer::write(int fd, const void *buf, size_t length) {
-		if(::write(fd,buf,length) != (ssize_t) length) {
-			throw system_error(errno, system_category(),_("I/O error writing image"));
+
+		const uint8_t *ptr = (const uint8_t *) buf;
+
+		while(length) {
+
+			ssize_t bytes = ::write(fd,ptr,length);
+			if(bytes < 0 && errno == EINTR) {
+				continue;
+			} else if(bytes <= 0) {
+				throw system_error(bytes ? errno : EIO, system_category(),_("I/O error writing image"));
+			}
+
+			ptr += bytes;
+			length -= bytes;
+
 		}
+
 	}
 
 	void Writer::finalize(int fd) {
@@ -26,6 +26,7 @@
  #include <reinstall/diskimage.h>
  #include <reinstall/dialogs.h>
  #include <udjat/tools/file.h>
+ #include <private/download.h>
  #include <stdexcept>
  #include <iostream>
  #include <unistd.h>
@@ -225,9 +226,8 @@
 			File::Path::mkdir(dirname.c_str());
 		}
 
-		File::copy(from,filename.c_str(),[&dialog](double current, double total){
+		Download::copy(from,filename.c_str(),[&dialog](double current, double total){
 			dialog.set_progress(current,total);
-			return true;
 		});
 
 	}
@@ -140,30 +140,18 @@
 				*/
 
 				// Write image.
-				{
-					progress.set_sub_title(_("Writing system image"));
-
-					debug("fs-length=",imgStat.st_size," bytes");
-
-					int64_t current = 0;
-					char buffer[2048];
-					while(current < imgStat.st_size) {
-
-						progress.set_progress(current,imgStat.st_size);
-						ssize_t bytes = read(fdImage,buffer,2048);
-						if(bytes < 0) {
-							throw system_error(errno,system_category(),"Error reading FS image");
-						} else if(bytes == 0) {
-							throw runtime_error("Unexpected EOF reading FS image");
-						}
-
-						writer->write(buffer,bytes);
-						current += bytes;
-
-					}
+				progress.set_sub_title(_("Writing system image"));
+				debug("fs-length=",imgStat.st_size," bytes");
 
+				try {
+					writer->burn(fdImage);
+				} catch(...) {
+					::close(fdImage);
+					throw;
 				}
 
+				::close(fdImage);
+
 				progress.set_sub_title(_("Finalizing"));
 
 				writer->finalize();
@@ -182,6 +170,10 @@
 
 	}
 
+	unsigned long long FSBuilder::capacity() const noexcept {
+		return imglen;
+	}
+
 	std::shared_ptr<Reinstall::Writer> FSBuilder::WriterFactory() {
 		debug("Returning USB writer");
 		return Reinstall::Writer::USBWriterFactory(*this);
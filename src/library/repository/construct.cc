@@ -35,11 +35,11 @@
  namespace Reinstall {
 
 	static inline Repository::Layout LayoutFactory(const pugi::xml_node &node) {
-		return (Repository::Layout) XML::StringFactory(node,"layout","value","apache").select("apache","mirrorcache",nullptr);
+		return (Repository::Layout) XML::StringFactory(node,"layout","value","apache").select("apache","mirrorcache","manifest",nullptr);
 	}
 
 	Repository::Path::Path(const pugi::xml_node &node)
-		: remote{XML::QuarkFactory(node,"remote").c_str()}, local{XML::QuarkFactory(node,"local").c_str()} {
+		: remote{XML::QuarkFactory(node,"remote").c_str()}, local{XML::QuarkFactory(node,"local").c_str()}, hybrid{XML::StringFactory(node,"hybrid").as_bool(false)} {
 
 		if(!(remote && *remote)) {
 			remote = XML::QuarkFactory(node,"url").c_str();
@@ -50,7 +50,12 @@
 
 	}
 
-	Repository::Repository(const pugi::xml_node &node) : NamedObject(node), path(node), slp(node), layout{LayoutFactory(node)} {
+	Repository::Repository(const pugi::xml_node &node) : NamedObject(node), path(node), slp(node), mirrors(node), layout{LayoutFactory(node)}, manifest{XML::QuarkFactory(node,"manifest").c_str()} {
+
+		if(!(manifest && *manifest)) {
+			manifest = "reinstall.manifest";
+		}
+
 	}
 
 	Repository::~Repository() {
@@ -69,7 +74,8 @@
 
 	const std::string Repository::get_url(bool expand) {
 
-		if(path.local && *path.local && access(path.local,R_OK) == 0) {
+		// Hybrid repositories are listed from remote, files are searched on the local path by local().
+		if(!path.hybrid && path.local && *path.local && access(path.local,R_OK) == 0) {
 			return String{"file://",path.local};
 		}
 
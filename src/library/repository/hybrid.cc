@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/repository.h>
+ #include <reinstall/checksum.h>
+ #include <private/cache.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <cstdlib>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Decode URL escapes (%20) on file path.
+	static std::string unescape(const char *str) {
+
+		std::string rc;
+
+		while(*str) {
+
+			if(*str == '%' && isxdigit(str[1]) && isxdigit(str[2])) {
+				char hex[3] = { str[1], str[2], 0 };
+				rc += (char) strtol(hex,NULL,16);
+				str += 3;
+			} else {
+				rc += *(str++);
+			}
+
+		}
+
+		return rc;
+
+	}
+
+	std::string Repository::local(const char *url, unsigned long long &length, const char *sha256, bool &verified) {
+
+		verified = false;
+
+		if(!(path.hybrid && path.local && *path.local)) {
+			return "";
+		}
+
+		std::string base{get_url(true)};
+		if(base.empty() || strncmp(url,base.c_str(),base.size())) {
+			return "";
+		}
+
+		const char *relative = url + base.size();
+		while(*relative == '/') {
+			relative++;
+		}
+
+		std::string filename{path.local};
+		if(filename[filename.size()-1] != '/') {
+			filename += '/';
+		}
+		filename += unescape(relative);
+
+		struct stat st;
+		if(stat(filename.c_str(),&st) || !S_ISREG(st.st_mode)) {
+			return "";
+		}
+
+		if(!length) {
+
+			// No length from the listing, ask the server.
+			try {
+				length = Cache::Validators{url}.length;
+			} catch(const std::exception &e) {
+				Logger::String{"Cant get length of '",url,"': ",e.what()}.trace(name());
+			}
+
+			if(!length && !(sha256 && *sha256)) {
+				Logger::String{"Cant check local copy of '",relative,"' without length or digest, using remote"}.trace(name());
+				return "";
+			}
+
+		}
+
+		if(length && (unsigned long long) st.st_size != length) {
+			Logger::String{"Local copy of '",relative,"' has the wrong length, using remote"}.trace(name());
+			return "";
+		}
+
+		if(sha256 && *sha256 && Config::Value<bool>("repository","verify-local",true)) {
+
+			std::string digest{sha256};
+			for(char &chr : digest) {
+				chr = tolower(chr);
+			}
+
+			try {
+
+				if(Checksum::compute(filename.c_str()) != digest) {
+					Logger::String{"Local copy of '",relative,"' has the wrong digest, using remote"}.warning(name());
+					return "";
+				}
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant verify local copy of '",relative,"': ",e.what()}.warning(name());
+				return "";
+
+			}
+
+			verified = true;
+
+		}
+
+		return string{"file://"} + filename;
+
+	}
+
+ }
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/repository.h>
+ #include <reinstall/action.h>
+ #include <private/meter.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <udjat/tools/xml.h>
+ #include <json/json.h>
+ #include <thread>
+ #include <chrono>
+ #include <algorithm>
+ #include <cctype>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	Repository::Mirrors::Mirrors(const pugi::xml_node &node)
+		: enabled{XML::StringFactory(node,"select-mirror").as_bool(Config::Value<bool>("mirrors","select",false))},
+			probe{XML::QuarkFactory(node,"mirror-probe").c_str()} {
+
+		for(pugi::xml_node child = node.child("mirror"); child; child = child.next_sibling("mirror")) {
+			const char *url = child.attribute("url").as_string();
+			if(*url) {
+				candidates.emplace_back(url);
+			}
+		}
+
+	}
+
+	/// @brief Get URLs from MirrorCache JSON mirror list.
+	/// @details The mirrors are in top level arrays, "l1", "l2", "l3" (by distance) or "mirrors", every entry with an "url".
+	static void mirrorlist(const Json::Value &value, std::vector<std::string> &urls) {
+
+		if(!value.isObject()) {
+			throw runtime_error("Unexpected mirror list format");
+		}
+
+		// Member names are sorted, nearest mirrors first.
+		for(const auto &name : value.getMemberNames()) {
+
+			if(!(name == "mirrors" || (name.size() > 1 && name[0] == 'l' && std::all_of(name.begin()+1,name.end(),::isdigit)))) {
+				continue;
+			}
+
+			const Json::Value &list = value[name];
+			if(!list.isArray()) {
+				continue;
+			}
+
+			for(const Json::Value &item : list) {
+
+				if(!item.isObject()) {
+					continue;
+				}
+
+				const Json::Value &url = item["url"];
+				if(url.isString() && strncasecmp(url.asCString(),"http",4) == 0) {
+					urls.emplace_back(url.asString());
+				}
+
+			}
+
+		}
+
+	}
+
+	void Repository::select_mirror() {
+
+		mirrors.probed = true;
+		mirrors.base = get_url(true);
+
+		if(mirrors.base.empty() || strncasecmp(mirrors.base.c_str(),"file://",7) == 0) {
+			return;
+		}
+
+		if(mirrors.base[mirrors.base.size()-1] != '/') {
+			mirrors.base += '/';
+		}
+
+		Meter::Progress progress;
+		progress.set_sub_title(_("Selecting mirror"));
+		progress.pulse();
+
+		// Build candidate list.
+		std::vector<std::string> urls{mirrors.base};
+		for(const std::string &url : mirrors.candidates) {
+			urls.push_back(url);
+		}
+
+		if(layout == MirrorCacheLayout) {
+
+			try {
+
+				Json::Value value;
+				Json::CharReaderBuilder builder;
+				JSONCPP_STRING err;
+
+				string text = Protocol::WorkerFactory( (mirrors.base + "?mirrorlist&json").c_str() )->get();
+
+				const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+				if(!reader->parse(text.c_str(), text.c_str()+text.size(), &value, &err)) {
+					throw runtime_error(err);
+				}
+
+				mirrorlist(value,urls);
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant get mirror list from '",mirrors.base,"': ",e.what()}.warning(name());
+
+			}
+
+		}
+
+		for(std::string &url : urls) {
+			if(url[url.size()-1] != '/') {
+				url += '/';
+			}
+		}
+
+		size_t limit = Config::Value<unsigned int>("mirrors","max-probes",8);
+		if(urls.size() > limit) {
+			urls.resize(limit);
+		}
+
+		if(urls.size() < 2) {
+			return;
+		}
+
+		Logger::String{"Probing ",urls.size()," mirror(s)"}.trace(name());
+
+		// Probe all candidates at the same time.
+		struct Result {
+			double rtt = 0;			///< @brief Seconds for a HEAD request.
+			double throughput = 0;	///< @brief Bytes per second reading the probe file.
+			bool valid = false;
+		};
+
+		std::vector<Result> results(urls.size());
+		std::vector<std::thread> threads;
+
+		unsigned long long probesize = Action::getImageSize(Config::Value<string>("mirrors","probe-size","256KB").c_str());
+
+		for(size_t ix = 0; ix < urls.size(); ix++) {
+
+			threads.emplace_back([this,&urls,&results,ix,probesize](){
+
+				const std::string &url = urls[ix];
+				Result &result = results[ix];
+
+				try {
+
+					auto start = std::chrono::steady_clock::now();
+
+					if(Protocol::WorkerFactory(url.c_str())->test() != 200) {
+						throw runtime_error("Unexpected response");
+					}
+
+					result.rtt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+					if(mirrors.probe && *mirrors.probe && probesize) {
+
+						auto worker = Protocol::WorkerFactory((url + (mirrors.probe[0] == '/' ? mirrors.probe+1 : mirrors.probe)).c_str());
+						worker->request("Range") = (string{"bytes=0-"} + std::to_string(probesize-1));
+
+						unsigned long long received = 0;
+						start = std::chrono::steady_clock::now();
+
+						worker->save([&received,probesize](unsigned long long, unsigned long long, const void *, size_t length){
+							received += length;
+							return received < probesize;
+						});
+
+						double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+						if(elapsed > 0 && received) {
+							result.throughput = received / elapsed;
+						}
+
+					}
+
+					result.valid = true;
+
+					Logger::String{
+						"Mirror '",url,"': rtt=",(unsigned int) (result.rtt * 1000),"ms throughput=",(unsigned long long) result.throughput,"B/s"
+					}.trace(name());
+
+				} catch(const std::exception &e) {
+
+					Logger::String{"Mirror '",url,"' has failed: ",e.what()}.trace(name());
+
+				}
+
+			});
+
+		}
+
+		for(auto &thread : threads) {
+			thread.join();
+		}
+
+		// Rank by the estimated time to get a reference file.
+		double reference = (double) Action::getImageSize(Config::Value<string>("mirrors","reference-size","64MB").c_str());
+
+		auto score = [reference](const Result &result) {
+			return result.rtt + (result.throughput > 0 ? reference / result.throughput : 0);
+		};
+
+		// If some mirror has the throughput measure ignore the ones without it.
+		bool measured = std::any_of(results.begin(),results.end(),[](const Result &result){
+			return result.valid && result.throughput > 0;
+		});
+
+		size_t best = urls.size();
+		for(size_t ix = 0; ix < urls.size(); ix++) {
+
+			if(!results[ix].valid || (measured && results[ix].throughput <= 0)) {
+				continue;
+			}
+
+			if(best == urls.size() || score(results[ix]) < score(results[best])) {
+				best = ix;
+			}
+
+		}
+
+		if(best == urls.size()) {
+			Logger::String{"No valid mirror, using '",mirrors.base,"'"}.warning(name());
+			return;
+		}
+
+		if(best) {
+			mirrors.selected = urls[best];
+			Logger::String{"Using mirror '",mirrors.selected,"'"}.info(name());
+		} else {
+			Logger::String{"The repository URL is the fastest mirror"}.trace(name());
+		}
+
+	}
+
+	std::string Repository::mirror(const char *url) {
+
+		if(!mirrors.enabled) {
+			return url;
+		}
+
+		std::lock_guard<std::mutex> lock(mirrors.guard);
+
+		if(!mirrors.probed) {
+			// First call, probe mirrors; the result is kept for the session.
+			select_mirror();
+		}
+
+		if(mirrors.selected.empty() || strncmp(url,mirrors.base.c_str(),mirrors.base.size())) {
+			return url;
+		}
+
+		return mirrors.selected + (url + mirrors.base.size());
+
+	}
+
+ }
@@ -25,61 +25,87 @@
  #include <udjat/tools/logger.h>
  #include <udjat/tools/intl.h>
  #include <private/mirror.h>
+ #include <private/cache.h>
 
  using namespace std;
  using namespace Udjat;
 
  namespace Reinstall {
 
-	void Mirror::apache(const char *name, const char *path, const char *url, std::vector<std::shared_ptr<Source>> &contents) {
+	void Mirror::apache(const char *path, const char *url, const std::function<void(const Entry &entry)> &call) {
 
-		// Get index and insert folder contents.
-		string index = Protocol::WorkerFactory(url)->get();
+		static const char *tag = "<a href=\"";
+		static const size_t taglen = strlen(tag);
 
-		if(index.empty()) {
-			throw runtime_error(Logger::Message(_("Empty response from {}"),url));
-		}
+		/// @brief Unparsed text (at most one incomplete link).
+		std::string buffer;
+		size_t received = 0;
 
-		for(auto href = index.find("<a href=\""); href != string::npos; href = index.find("<a href=\"",href)) {
+		auto parse = [&](const char *text, size_t length) {
 
-			auto from = href+9;
-			href = index.find("\"",from);
-			if(href == string::npos) {
-				throw runtime_error(Logger::Message(_("Unable to parse file list from {}"),url));
-			}
+			buffer.append(text,length);
+			received += length;
 
-			string link = index.substr(from,href-from);
+			size_t pos = 0;
 
-			if(link[0] =='/' || link[0] == '?' || link[0] == '.' || link[0] == '$')
-				continue;
+			while(true) {
 
-			if(link.size() >= 7 && strncmp(link.c_str(),"http://",7) == 0 ) {
-				continue;
-			}
+				auto href = buffer.find(tag,pos);
 
-			if(link.size() >= 8 && strncmp(link.c_str(),"https://",8) == 0 ) {
-				continue;
-			}
+				if(href == string::npos) {
+					// Keep a possible partial tag for the next block.
+					if(buffer.size() >= taglen && pos < buffer.size() - taglen + 1) {
+						pos = buffer.size() - taglen + 1;
+					}
+					break;
+				}
+
+				auto from = href+taglen;
+				auto to = buffer.find('"',from);
+
+				if(to == string::npos) {
+					// Incomplete link, wait for more data.
+					pos = href;
+					break;
+				}
+
+				pos = to+1;
 
-			string remote = url + link;
-			string local = path + link;
+				string link = buffer.substr(from,to-from);
 
-			if(remote[remote.size()-1] == '/') {
+				if(link.empty() || link[0] =='/' || link[0] == '?' || link[0] == '.' || link[0] == '$')
+					continue;
 
-				// Its a folder, expand it.
-				Mirror::apache(name,local.c_str(),remote.c_str(),contents);
+				if(link.size() >= 7 && strncmp(link.c_str(),"http://",7) == 0 ) {
+					continue;
+				}
 
-			} else {
+				if(link.size() >= 8 && strncmp(link.c_str(),"https://",8) == 0 ) {
+					continue;
+				}
+
+				Entry entry;
+				entry.url = url + link;
+				entry.path = path + link;
+				entry.folder = (entry.url[entry.url.size()-1] == '/');
+
+				call(entry);
 
-				// Its a file, append in the content list.
-				Logger::String {
-					remote," -> ",local
-				}.trace(name);
-				contents.push_back(std::make_shared<Source>(name,remote.c_str(),local.c_str()));
 			}
 
-			href = from+1;
+			buffer.erase(0,pos);
+
+		};
+
+		// Parse index while receiving it.
+		Cache::getInstance().text(url,parse);
+
+		if(!received) {
+			throw runtime_error(Logger::Message(_("Empty response from {}"),url));
+		}
 
+		if(buffer.find(tag) != string::npos) {
+			throw runtime_error(Logger::Message(_("Unable to parse file list from {}"),url));
 		}
 
 	}
@@ -0,0 +1,586 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/cache.h>
+ #include <reinstall/action.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/file.h>
+ #include <udjat/tools/string.h>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <sys/file.h>
+ #include <dirent.h>
+ #include <vector>
+ #include <algorithm>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <fstream>
+ #include <sstream>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Get validators from server response.
+	static void set(Cache::Validators &validators, Protocol::Worker &worker) {
+
+		validators.etag = worker.response("ETag");
+		validators.modified = worker.response("Last-Modified");
+
+		std::string value = worker.response("Content-Length");
+		if(!value.empty()) {
+			validators.length = std::stoull(value);
+		}
+
+		validators.ranges = (strcasecmp(worker.response("Accept-Ranges").c_str(),"bytes") == 0);
+
+	}
+
+	Cache::Validators::Validators(const char *url) {
+
+		auto worker = Protocol::WorkerFactory(url);
+
+		if(worker->test() != 200) {
+			return;
+		}
+
+		set(*this,*worker);
+
+	}
+
+	bool Cache::Validators::operator==(const Validators &v) const noexcept {
+
+		if(!(etag.empty() || v.etag.empty())) {
+			return etag == v.etag;
+		}
+
+		return modified == v.modified && length == v.length;
+
+	}
+
+	bool Cache::Validators::load(const char *filename, const char *url) {
+
+		std::ifstream in{filename};
+		std::string line;
+		std::string u;
+
+		while(std::getline(in,line)) {
+
+			auto pos = line.find('=');
+			if(pos == string::npos) {
+				continue;
+			}
+
+			std::string name{line.substr(0,pos)};
+			std::string value{line.substr(pos+1)};
+
+			if(name == "url") {
+				u = value;
+			} else if(name == "etag") {
+				etag = value;
+			} else if(name == "modified") {
+				modified = value;
+			} else if(name == "length") {
+				length = std::stoull(value);
+			}
+
+		}
+
+		return u == url && *this;
+
+	}
+
+	void Cache::Validators::save(const char *filename, const char *url) const {
+		std::ofstream out{filename,std::ofstream::trunc};
+		out << "url=" << url << endl
+			<< "etag=" << etag << endl
+			<< "modified=" << modified << endl
+			<< "length=" << length << endl;
+	}
+
+	Cache & Cache::getInstance() {
+		static Cache instance;
+		return instance;
+	}
+
+	Cache::Cache()
+		: path{(std::string) Config::Value<string>("cache","path","/var/cache/" PRODUCT_NAME)},
+			maxlength{Action::getImageSize(Config::Value<string>("cache","max-size","8GB").c_str())} {
+
+		if(!Config::Value<bool>("cache","enabled",true) || path.empty()) {
+			Logger::String{"Download cache is disabled"}.trace("cache");
+			path.clear();
+			return;
+		}
+
+		try {
+
+			File::Path::mkdir(path.c_str());
+
+			if(access(path.c_str(),W_OK)) {
+				throw system_error(errno,system_category(),path);
+			}
+
+		} catch(const std::exception &e) {
+
+			Logger::String{"Download cache is not available: ",e.what()}.warning("cache");
+			path.clear();
+			return;
+
+		}
+
+		if(path[path.size()-1] != '/') {
+			path += '/';
+		}
+
+		Logger::String{"Using '",path,"' for download cache, up to ",String{}.set_byte(maxlength)}.trace("cache");
+
+	}
+
+	std::string Cache::key(const char *url) {
+
+		size_t hash = std::hash<std::string>{}(string{url});
+
+		char buffer[20];
+		snprintf(buffer,sizeof(buffer),"%016llx",(unsigned long long) hash);
+		return buffer;
+
+	}
+
+	bool Cache::revalidate(const char *url, const std::string &filename, Validators &validators) {
+
+		Validators cached;
+		struct stat st;
+
+		if(!cached.load((filename + ".meta").c_str(),url) || stat(filename.c_str(),&st) || (cached.length && ((unsigned long long) st.st_size) != cached.length)) {
+			return false;
+		}
+
+		auto worker = Protocol::WorkerFactory(url);
+
+		if(!cached.etag.empty()) {
+			worker->request("If-None-Match") = cached.etag;
+		}
+
+		if(!cached.modified.empty()) {
+			worker->request("If-Modified-Since") = cached.modified;
+		}
+
+		int status = 0;
+
+		try {
+
+			status = worker->test();
+
+		} catch(const std::exception &e) {
+
+			Logger::String{"Cant revalidate '",url,"', using cached copy: ",e.what()}.warning("cache");
+			status = 304;
+
+		}
+
+		if(status == 200) {
+			set(validators,*worker);
+		}
+
+		if(status == 304 || (status == 200 && validators == cached)) {
+
+			// Not modified, update timestamp for LRU.
+			lock_guard<mutex> lock(guard);
+			utimensat(AT_FDCWD,filename.c_str(),NULL,0);
+			active.insert(filename);
+
+			Logger::String{"Using cached copy of '",url,"'"}.trace("cache");
+			return true;
+
+		}
+
+		Logger::String{"Cached copy of '",url,"' is outdated (",status,")"}.trace("cache");
+		return false;
+
+	}
+
+	std::string Cache::get(const char *url, const std::function<void(const char *filename)> &download) {
+
+		if(path.empty()) {
+			return "";
+		}
+
+		std::string filename{path + key(url)};
+
+		Validators validators;
+
+		if(revalidate(url,filename,validators)) {
+			return filename;
+		}
+
+		if(!validators) {
+			validators = Validators{url};
+		}
+
+		if(!validators) {
+			Logger::String{"No validators for '",url,"', ignoring cache"}.trace("cache");
+			return "";
+		}
+
+		// Download to a stable name, partial data is resumed by the next run.
+		std::string partial{filename + ".download"};
+
+		// Another process can be getting the same URL, wait for it.
+		std::string lockname{filename + ".lock"};
+		int lockfd = ::open(lockname.c_str(),O_RDWR|O_CREAT,0644);
+		if(lockfd < 0) {
+			throw system_error(errno,system_category(),lockname);
+		}
+
+		if(::flock(lockfd,LOCK_EX|LOCK_NB)) {
+
+			Logger::String{"Waiting for other process downloading '",url,"'"}.trace("cache");
+
+			if(::flock(lockfd,LOCK_EX)) {
+				int err = errno;
+				::close(lockfd);
+				throw system_error(err,system_category(),lockname);
+			}
+
+			if(revalidate(url,filename,validators)) {
+				::close(lockfd);
+				return filename;
+			}
+
+		}
+
+		{
+			lock_guard<mutex> lock(guard);
+			active.insert(partial + ".part");
+		}
+
+		try {
+
+			download(partial.c_str());
+
+			lock_guard<mutex> lock(guard);
+
+			if(rename(partial.c_str(),filename.c_str())) {
+				throw system_error(errno,system_category(),filename);
+			}
+
+			validators.save((filename + ".meta").c_str(),url);
+			active.erase(partial + ".part");
+
+		} catch(...) {
+
+			// Keep the partial file for resume, it's evicted as the other entries.
+			{
+				lock_guard<mutex> lock(guard);
+				active.erase(partial + ".part");
+				evict();
+			}
+			::close(lockfd);
+			throw;
+
+		}
+
+		::close(lockfd);
+
+		Logger::String{"'",url,"' was stored in cache"}.trace("cache");
+
+		lock_guard<mutex> lock(guard);
+		active.insert(filename);
+		evict();
+
+		return filename;
+
+	}
+
+	bool Cache::contains(const char *url) {
+
+		if(path.empty()) {
+			return false;
+		}
+
+		std::string filename{path + key(url)};
+
+		Validators cached;
+		struct stat st;
+
+		return cached.load((filename + ".meta").c_str(),url) && !stat(filename.c_str(),&st) && (!cached.length || ((unsigned long long) st.st_size) == cached.length);
+
+	}
+
+	void Cache::text(const char *url, const std::function<void(const char *text, size_t length)> &call) {
+
+		if(path.empty() || !Config::Value<bool>("cache","indexes",true)) {
+			Protocol::WorkerFactory(url)->save([&call](unsigned long long, unsigned long long, const void *buf, size_t length){
+				call((const char *) buf,length);
+				return true;
+			});
+			return;
+		}
+
+		std::string filename{path + key(url)};
+
+		Validators validators;
+
+		if(revalidate(url,filename,validators)) {
+
+			std::ifstream in{filename,std::ifstream::binary};
+			char buffer[16384];
+
+			while(in.read(buffer,sizeof(buffer)) || in.gcount()) {
+				call(buffer,(size_t) in.gcount());
+			}
+
+			return;
+		}
+
+		// Get it, store a copy while parsing.
+		std::string tempname{filename + ".XXXXXX"};
+
+		int fd = mkstemp((char *) tempname.data());
+		if(fd < 0) {
+			throw system_error(errno,system_category(),tempname);
+		}
+		::close(fd);
+
+		std::ofstream out{tempname,std::ofstream::binary|std::ofstream::trunc};
+		unsigned long long length = 0;
+
+		auto worker = Protocol::WorkerFactory(url);
+
+		try {
+
+			worker->save([&](unsigned long long, unsigned long long, const void *buf, size_t bytes){
+				out.write((const char *) buf,bytes);
+				length += bytes;
+				call((const char *) buf,bytes);
+				return true;
+			});
+
+		} catch(...) {
+
+			out.close();
+			remove(tempname.c_str());
+			throw;
+
+		}
+
+		out.close();
+
+		// Store with the validators from the same response.
+		validators = Validators{};
+		set(validators,*worker);
+
+		if(!validators || out.fail()) {
+			remove(tempname.c_str());
+			return;
+		}
+
+		lock_guard<mutex> lock(guard);
+
+		if(rename(tempname.c_str(),filename.c_str())) {
+			remove(tempname.c_str());
+			return;
+		}
+
+		validators.length = length;
+		validators.save((filename + ".meta").c_str(),url);
+		active.insert(filename);
+
+	}
+
+	bool Cache::load(const char *url, const char *path, Listing &listing) {
+
+		if(this->path.empty()) {
+			return false;
+		}
+
+		std::ifstream in{this->path + "listings/" + key((string{url} + "\n" + path).c_str())};
+		if(!in) {
+			return false;
+		}
+
+		std::string line, u, p;
+		listing.items.clear();
+		listing.updated = 0;
+
+		while(std::getline(in,line)) {
+
+			if(line.compare(0,4,"url=") == 0) {
+				u = line.substr(4);
+			} else if(line.compare(0,5,"path=") == 0) {
+				p = line.substr(5);
+			} else if(line.compare(0,8,"updated=") == 0) {
+				listing.updated = (time_t) std::stoll(line.substr(8));
+			} else {
+
+				// length<TAB>mtime<TAB>url<TAB>path
+				std::istringstream fields{line};
+				Listing::Item item;
+				std::string length, mtime;
+
+				if(std::getline(fields,length,'\t') && std::getline(fields,mtime,'\t') && std::getline(fields,item.url,'\t') && std::getline(fields,item.path)) {
+					item.length = std::stoull(length);
+					item.mtime = (time_t) std::stoll(mtime);
+					listing.items.push_back(item);
+				}
+
+			}
+
+		}
+
+		return u == url && p == path && listing.updated;
+
+	}
+
+	void Cache::save(const char *url, const char *path, const Listing &listing) {
+
+		if(this->path.empty()) {
+			return;
+		}
+
+		std::string dirname{this->path + "listings/"};
+		File::Path::mkdir(dirname.c_str());
+
+		std::string filename{dirname + key((string{url} + "\n" + path).c_str())};
+		std::string tempname{filename + ".XXXXXX"};
+
+		int fd = mkstemp((char *) tempname.data());
+		if(fd < 0) {
+			throw system_error(errno,system_category(),tempname);
+		}
+		::close(fd);
+
+		{
+			std::ofstream out{tempname,std::ofstream::trunc};
+
+			out << "url=" << url << endl
+				<< "path=" << path << endl
+				<< "updated=" << listing.updated << endl;
+
+			for(const Listing::Item &item : listing.items) {
+				out << item.length << '\t' << item.mtime << '\t' << item.url << '\t' << item.path << endl;
+			}
+
+			out.close();
+
+			if(out.fail()) {
+				remove(tempname.c_str());
+				throw runtime_error(Logger::Message("Cant write '{}'",tempname));
+			}
+		}
+
+		if(rename(tempname.c_str(),filename.c_str())) {
+			int err = errno;
+			remove(tempname.c_str());
+			throw system_error(err,system_category(),filename);
+		}
+
+	}
+
+	void Cache::evict() {
+
+		struct Entry {
+			std::string name;
+			time_t mtime;
+			unsigned long long length;
+		};
+
+		std::vector<Entry> entries;
+		unsigned long long total = 0LL;
+
+		DIR *dir = opendir(path.c_str());
+		if(!dir) {
+			Logger::String{"Cant open '",path,"': ",strerror(errno)}.error("cache");
+			return;
+		}
+
+		for(struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+
+			if(entry->d_name[0] == '.') {
+				continue;	// Ignore hidden files.
+			}
+
+			const char *ext = strrchr(entry->d_name,'.');
+			if(ext && (!strcmp(ext,".meta") || !strcmp(ext,".info") || !strcmp(ext,".lock"))) {
+				continue;	// Metadata, removed with the data file.
+			}
+
+			std::string filename{path + entry->d_name};
+
+			struct stat st;
+			if(stat(filename.c_str(),&st) || !S_ISREG(st.st_mode)) {
+				continue;
+			}
+
+			total += st.st_size;
+
+			if(!active.count(filename)) {
+				entries.push_back(Entry{filename,st.st_mtime,(unsigned long long) st.st_size});
+			}
+
+		}
+
+		closedir(dir);
+
+		if(total <= maxlength) {
+			return;
+		}
+
+		std::sort(entries.begin(),entries.end(),[](const Entry &a, const Entry &b){
+			return a.mtime < b.mtime;
+		});
+
+		for(const Entry &entry : entries) {
+
+			if(total <= maxlength) {
+				break;
+			}
+
+			Logger::String{"Removing '",entry.name,"' (",String{}.set_byte(entry.length),")"}.trace("cache");
+
+			if(remove(entry.name.c_str())) {
+				Logger::String{"Cant remove '",entry.name,"': ",strerror(errno)}.error("cache");
+				continue;
+			}
+
+			size_t length = entry.name.size();
+			if(length > 5 && entry.name.compare(length-5,5,".part") == 0) {
+				// Partial download, remove the resume metadata.
+				remove((entry.name.substr(0,length-5) + ".info").c_str());
+			} else {
+				remove((entry.name + ".meta").c_str());
+			}
+
+			total -= entry.length;
+
+		}
+
+	}
+
+ }
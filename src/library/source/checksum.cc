@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/checksum.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <openssl/evp.h>
+ #include <cstring>
+ #include <sstream>
+ #include <cctype>
+ #include <unordered_map>
+ #include <mutex>
+ #include <future>
+ #include <memory>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	class Checksum::Context {
+	public:
+		EVP_MD_CTX *md;
+		const EVP_MD *type;
+
+		Context(const char *name) : md{EVP_MD_CTX_new()} {
+
+			if(!md) {
+				throw runtime_error("Unable to allocate digest context");
+			}
+
+			// Metalink uses 'sha-256', openssl 'sha256'.
+			std::string str;
+			for(const char *ptr = name; *ptr; ptr++) {
+				if(*ptr != '-') {
+					str += tolower(*ptr);
+				}
+			}
+
+			type = EVP_get_digestbyname(str.c_str());
+			if(!type) {
+				EVP_MD_CTX_free(md);
+				throw runtime_error(Logger::Message(_("Unsupported digest '{}'"),name));
+			}
+
+		}
+
+		~Context() {
+			EVP_MD_CTX_free(md);
+		}
+
+	};
+
+	static bool is_digest(const std::string &str, size_t length = 64) {
+
+		if(str.size() != length) {
+			return false;
+		}
+
+		for(const char chr : str) {
+			if(!isxdigit(chr)) {
+				return false;
+			}
+		}
+
+		return true;
+
+	}
+
+	Checksum::Checksum(const char *e, const char *type) : context{new Context(type)}, expected{e} {
+
+		for(char &chr : expected) {
+			chr = tolower(chr);
+		}
+
+		if(!is_digest(expected,EVP_MD_size(context->type) * 2)) {
+			delete context;
+			throw runtime_error(Logger::Message(_("Invalid {} digest '{}'"),type,e));
+		}
+
+		reset();
+
+	}
+
+	Checksum::~Checksum() {
+		delete context;
+	}
+
+	/// @brief Digests from a checksum file.
+	struct UDJAT_PRIVATE Digests {
+
+		/// @brief Digest by file name.
+		std::unordered_map<std::string,std::string> files;
+
+		/// @brief Digest without file name (single digest files, ex: 'file.iso.sha256').
+		std::string unnamed;
+
+		Digests(const char *url) {
+
+			std::istringstream in{Protocol::WorkerFactory(url)->get()};
+
+			// Accepts 'digest  filename', 'digest *filename', 'SHA256 (filename) = digest' and 'digest'.
+			std::string line;
+			size_t count = 0;
+
+			while(std::getline(in,line)) {
+
+				std::string digest, file;
+
+				if(strncasecmp(line.c_str(),"SHA256 (",8) == 0) {
+
+					auto pos = line.find(") = ");
+					if(pos == string::npos) {
+						continue;
+					}
+					file = line.substr(8,pos-8);
+					digest = line.substr(pos+4);
+
+				} else {
+
+					std::istringstream fields{line};
+					fields >> digest >> file;
+					if(!file.empty() && file[0] == '*') {
+						file.erase(0,1);
+					}
+
+				}
+
+				while(!digest.empty() && isspace(digest.back())) {
+					digest.pop_back();
+				}
+
+				if(!is_digest(digest)) {
+					continue;
+				}
+
+				count++;
+
+				auto slash = file.rfind('/');
+				if(slash != string::npos) {
+					file.erase(0,slash+1);
+				}
+
+				if(file.empty()) {
+					unnamed = digest;
+				} else {
+					files[file] = digest;
+				}
+
+			}
+
+			if(count != 1) {
+				// The unnamed digest is only valid when it's the only one.
+				unnamed.clear();
+			}
+
+		}
+
+	};
+
+	std::string Checksum::fetch(const char *url, const char *filename) {
+
+		const char *name = strrchr(filename,'/');
+		name = (name ? name+1 : filename);
+
+		// Checksum files are shared by all files on the same directory, get them only once.
+		static std::mutex guard;
+		static std::unordered_map<std::string,std::shared_future<std::shared_ptr<Digests>>> cache;
+
+		std::shared_future<std::shared_ptr<Digests>> future;
+		std::promise<std::shared_ptr<Digests>> promise;
+		bool owner = false;
+
+		{
+			lock_guard<mutex> lock(guard);
+			auto it = cache.find(url);
+			if(it == cache.end()) {
+				future = promise.get_future().share();
+				cache[url] = future;
+				owner = true;
+			} else {
+				future = it->second;
+			}
+		}
+
+		if(owner) {
+
+			try {
+
+				promise.set_value(make_shared<Digests>(url));
+
+			} catch(...) {
+
+				// Failed, let the next request try again.
+				{
+					lock_guard<mutex> lock(guard);
+					cache.erase(url);
+				}
+				promise.set_exception(current_exception());
+
+			}
+
+		}
+
+		std::shared_ptr<Digests> digests = future.get();
+
+		auto it = digests->files.find(name);
+		if(it != digests->files.end()) {
+			return it->second;
+		}
+
+		if(!digests->unnamed.empty()) {
+			return digests->unnamed;
+		}
+
+		throw runtime_error(Logger::Message(_("Cant find checksum for '{}' on {}"),name,url));
+
+	}
+
+	void Checksum::reset() {
+		if(EVP_DigestInit_ex(context->md,context->type,NULL) != 1) {
+			throw runtime_error("Unable to initialize digest");
+		}
+	}
+
+	void Checksum::update(const void *buf, size_t length) {
+		if(EVP_DigestUpdate(context->md,buf,length) != 1) {
+			throw runtime_error("Unable to update digest");
+		}
+	}
+
+	void Checksum::update(const char *filename) {
+
+		int fd = ::open(filename,O_RDONLY);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		try {
+
+			char buffer[16384];
+			ssize_t bytes;
+			while((bytes = ::read(fd,buffer,sizeof(buffer))) != 0) {
+				if(bytes < 0) {
+					throw system_error(errno,system_category(),filename);
+				}
+				update(buffer,bytes);
+			}
+
+		} catch(...) {
+			::close(fd);
+			throw;
+		}
+
+		::close(fd);
+
+	}
+
+	/// @brief Finalize digest, get it as lowercase hex.
+	static std::string finalize(EVP_MD_CTX *md) {
+
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int length = 0;
+
+		if(EVP_DigestFinal_ex(md,digest,&length) != 1) {
+			throw runtime_error("Unable to finalize digest");
+		}
+
+		std::string computed;
+		for(unsigned int ix = 0; ix < length; ix++) {
+			char hex[3];
+			snprintf(hex,sizeof(hex),"%02x",digest[ix]);
+			computed += hex;
+		}
+
+		return computed;
+
+	}
+
+	std::string Checksum::finalize() {
+		return Reinstall::finalize(context->md);
+	}
+
+	std::string Checksum::compute(const char *filename, const char *type) {
+
+		Context context{type};
+
+		if(EVP_DigestInit_ex(context.md,context.type,NULL) != 1) {
+			throw runtime_error("Unable to initialize digest");
+		}
+
+		int fd = ::open(filename,O_RDONLY);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		try {
+
+			char buffer[16384];
+			ssize_t bytes;
+			while((bytes = ::read(fd,buffer,sizeof(buffer))) != 0) {
+				if(bytes < 0) {
+					throw system_error(errno,system_category(),filename);
+				}
+				if(EVP_DigestUpdate(context.md,buffer,bytes) != 1) {
+					throw runtime_error("Unable to update digest");
+				}
+			}
+
+		} catch(...) {
+			::close(fd);
+			throw;
+		}
+
+		::close(fd);
+
+		return Reinstall::finalize(context.md);
+
+	}
+
+	bool Checksum::test() {
+		return finalize() == expected;
+	}
+
+	void Checksum::verify(const char *url) {
+
+		std::string computed{finalize()};
+
+		if(computed != expected) {
+			Logger::String{"Checksum mismatch on '",url,"': expected ",expected," got ",computed}.error("checksum");
+			throw runtime_error(Logger::Message(_("Checksum mismatch on {}"),url));
+		}
+
+		Logger::String{"Checksum of '",url,"' is valid"}.trace("checksum");
+
+	}
+
+ }
@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/download.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <algorithm>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ #ifdef __linux__
+	#include <sys/ioctl.h>
+	#include <sys/sendfile.h>
+	#include <linux/fs.h>
+ #endif // __linux__
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Size of every kernel copy request, keeps the progress updated on large files.
+	static const size_t chunk = 0x1000000;
+
+	/// @brief Check if the error means 'method not available for these files'.
+	static bool unsupported(int err) noexcept {
+		return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == ENOTTY || err == EBADF;
+	}
+
+	void Download::copy(const char *from, const char *to, const std::function<void(double current, double total)> &progress) {
+
+		int in = ::open(from,O_RDONLY);
+		if(in < 0) {
+			throw system_error(errno,system_category(),from);
+		}
+
+		int out = ::open(to,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if(out < 0) {
+			int err = errno;
+			::close(in);
+			throw system_error(err,system_category(),to);
+		}
+
+		try {
+
+			struct stat st;
+			if(fstat(in,&st)) {
+				throw system_error(errno,system_category(),from);
+			}
+
+			unsigned long long length = st.st_size;
+			unsigned long long offset = 0;
+
+			progress(0,length);
+
+ #ifdef __linux__
+
+  #ifdef FICLONE
+			// Same filesystem with shared extents (btrfs, xfs), just clone it.
+			if(length && ioctl(out,FICLONE,in) == 0) {
+				Logger::String{"'",to,"' is a reflink of '",from,"'"}.trace("copy");
+				progress(length,length);
+				::close(in);
+				::close(out);
+				return;
+			}
+  #endif // FICLONE
+
+			// Copy inside the kernel.
+			while(offset < length) {
+
+				ssize_t bytes = copy_file_range(in,NULL,out,NULL,std::min((unsigned long long) chunk,length-offset),0);
+
+				if(bytes < 0 && offset == 0 && unsupported(errno)) {
+					break;
+				} else if(bytes < 0) {
+					throw system_error(errno,system_category(),to);
+				} else if(bytes == 0) {
+					throw runtime_error(Logger::Message(_("Unexpected EOF reading {}"),from));
+				}
+
+				offset += bytes;
+				progress(offset,length);
+
+			}
+
+			// Not in the same filesystem type on older kernels, try sendfile().
+			while(offset < length) {
+
+				ssize_t bytes = sendfile(out,in,NULL,std::min((unsigned long long) chunk,length-offset));
+
+				if(bytes < 0 && offset == 0 && unsupported(errno)) {
+					break;
+				} else if(bytes < 0) {
+					throw system_error(errno,system_category(),to);
+				} else if(bytes == 0) {
+					throw runtime_error(Logger::Message(_("Unexpected EOF reading {}"),from));
+				}
+
+				offset += bytes;
+				progress(offset,length);
+
+			}
+
+ #endif // __linux__
+
+			// Fallback, copy in user space.
+			if(offset < length) {
+
+				Logger::String{"Kernel copy of '",from,"' is not available, using read/write"}.trace("copy");
+
+				char buffer[65536];
+				while(offset < length) {
+
+					ssize_t bytes = ::read(in,buffer,sizeof(buffer));
+					if(bytes < 0) {
+						throw system_error(errno,system_category(),from);
+					} else if(bytes == 0) {
+						throw runtime_error(Logger::Message(_("Unexpected EOF reading {}"),from));
+					}
+
+					if(::write(out,buffer,bytes) != bytes) {
+						throw system_error(errno,system_category(),to);
+					}
+
+					offset += bytes;
+					progress(offset,length);
+
+				}
+
+			}
+
+		} catch(...) {
+
+			::close(in);
+			::close(out);
+			remove(to);
+			throw;
+
+		}
+
+		::close(in);
+
+		if(::close(out)) {
+			throw system_error(errno,system_category(),to);
+		}
+
+	}
+
+ }
@@ -0,0 +1,398 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/download.h>
+ #include <reinstall/action.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <fstream>
+ #include <string>
+ #include <ctime>
+ #include <memory>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <chrono>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Metadata for partial downloads.
+	struct UDJAT_PRIVATE PartialInfo {
+
+		std::string url;
+		std::string etag;
+		std::string modified;
+		unsigned long long length = 0LL;
+
+		PartialInfo(const char *u) : url{u} {
+		}
+
+		/// @brief Load metadata from file.
+		/// @return true if the file has metadata for the same url.
+		bool load(const char *filename) {
+
+			std::ifstream in{filename};
+			std::string line;
+
+			std::string u;
+			while(std::getline(in,line)) {
+
+				auto pos = line.find('=');
+				if(pos == string::npos) {
+					continue;
+				}
+
+				std::string name{line.substr(0,pos)};
+				std::string value{line.substr(pos+1)};
+
+				if(name == "url") {
+					u = value;
+				} else if(name == "etag") {
+					etag = value;
+				} else if(name == "modified") {
+					modified = value;
+				} else if(name == "length") {
+					length = std::stoull(value);
+				}
+
+			}
+
+			if(u != url) {
+				etag.clear();
+				modified.clear();
+				length = 0LL;
+				return false;
+			}
+
+			return true;
+
+		}
+
+		void save(const char *filename) const {
+			std::ofstream out{filename,std::ofstream::trunc};
+			out << "url=" << url << endl
+				<< "etag=" << etag << endl
+				<< "modified=" << modified << endl
+				<< "length=" << length << endl;
+		}
+
+	};
+
+	/// @brief State of a transfer running on a secondary thread.
+	struct UDJAT_PRIVATE Transfer {
+		std::mutex guard;
+		std::condition_variable changed;
+		time_t activity = 0;			///< @brief When the last data was received.
+		bool abandoned = false;			///< @brief The transfer has stalled and was abandoned.
+		bool finished = false;
+		std::exception_ptr failed;
+	};
+
+	void Download::resumable(const char *url, const char *filename, const std::function<void(double current, double total)> &progress, bool persistent, Checksum *checksum) {
+
+		std::string partial{string{filename} + ".part"};
+		std::string infofile{string{filename} + ".info"};
+
+		unsigned int retries = Config::Value<unsigned int>("download","retries",5);
+		unsigned long long minrate = Action::getImageSize(Config::Value<string>("download","min-throughput","1KB").c_str());
+		time_t window = (time_t) Config::Value<unsigned int>("download","stall-time",30);
+
+		PartialInfo info{url};
+		unsigned long long offset = 0LL;
+
+		if(info.load(infofile.c_str())) {
+			struct stat st;
+			if(stat(partial.c_str(),&st) == 0) {
+				offset = st.st_size;
+			}
+		}
+
+		if(offset && checksum) {
+			// Resuming, start digest with the data from the previous run.
+			checksum->update(partial.c_str());
+		}
+
+		int fd = ::open(partial.c_str(),O_WRONLY|O_CREAT,0644);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),partial);
+		}
+
+		try {
+
+			unsigned int failures = 0;
+
+			while(!(info.length && offset >= info.length)) {
+
+				auto worker = Protocol::WorkerFactory(url);
+
+				if(offset) {
+
+					Logger::String{"Resuming '",url,"' from offset ",offset}.info("download");
+					worker->request("Range") = (string{"bytes="} + std::to_string(offset) + "-");
+
+					if(!info.etag.empty()) {
+						worker->request("If-Range") = info.etag;
+					} else if(!info.modified.empty()) {
+						worker->request("If-Range") = info.modified;
+					}
+
+				}
+
+				if(ftruncate(fd,offset)) {
+					throw system_error(errno,system_category(),partial);
+				}
+
+				unsigned long long start = offset;
+				bool first = true;
+				std::exception_ptr fatal;
+				bool stalled = false;
+				bool complete = false;
+
+				struct {
+					time_t start;
+					unsigned long long bytes = 0;
+				} sample;
+
+				sample.start = time(0);
+
+				// The transfer runs on a secondary thread, a connection not sending any data doesn't call
+				// the callback, this thread abandons it after 'stall-time' seconds without data.
+				auto state = make_shared<Transfer>();
+				state->activity = time(0);
+
+				std::thread transfer{[worker,state,&first,&fatal,&stalled,&offset,&start,&info,&infofile,&partial,&checksum,&sample,fd,window,minrate,url](){
+
+					std::exception_ptr failed;
+
+					try {
+
+						worker->save([&](unsigned long long, unsigned long long total, const void *buf, size_t length){
+
+							lock_guard<mutex> lock(state->guard);
+
+							if(state->abandoned) {
+								// Stalled, the download thread is not waiting anymore.
+								return false;
+							}
+
+							state->activity = time(0);
+
+							if(first) {
+
+								first = false;
+
+								if(offset && worker->response("Content-Range").empty()) {
+
+									// Server has ignored the range request or the file has changed, restart.
+									Logger::String{"Server has sent the full contents of '",url,"', restarting"}.warning("download");
+									offset = start = 0LL;
+									if(ftruncate(fd,0)) {
+										throw system_error(errno,system_category(),partial);
+									}
+
+									if(checksum) {
+										checksum->reset();
+									}
+
+								}
+
+								info.etag = worker->response("ETag");
+								info.modified = worker->response("Last-Modified");
+								info.length = (total ? offset + total : 0LL);
+								info.save(infofile.c_str());
+
+								if(info.length) {
+									// Reserve the disk space, fail now if the file doesn't fit.
+									try {
+										preallocate(fd,partial.c_str(),info.length,false);
+									} catch(...) {
+										fatal = current_exception();
+										throw;
+									}
+								}
+
+							}
+
+							if(pwrite(fd,buf,length,offset) != (ssize_t) length) {
+								throw system_error(errno,system_category(),partial);
+							}
+
+							if(checksum) {
+								checksum->update(buf,length);
+							}
+
+							offset += length;
+
+							// Check for slow transfer.
+							sample.bytes += length;
+							time_t now = time(0);
+							if((now - sample.start) >= window) {
+
+								if((sample.bytes / (now - sample.start)) < minrate) {
+									Logger::String{"Transfer of '",url,"' is below ",minrate," bytes/s, reconnecting"}.warning("download");
+									stalled = true;
+									return false;
+								}
+
+								sample.start = now;
+								sample.bytes = 0;
+
+							}
+
+							return true;
+
+						});
+
+					} catch(...) {
+
+						failed = current_exception();
+
+					}
+
+					lock_guard<mutex> lock(state->guard);
+					if(!state->abandoned) {
+						state->failed = failed;
+						state->finished = true;
+						state->changed.notify_all();
+					}
+
+				}};
+
+				{
+					unique_lock<mutex> lock(state->guard);
+
+					while(!state->finished) {
+
+						state->changed.wait_for(lock,std::chrono::seconds(1));
+
+						if(!state->finished && (time(0) - state->activity) >= window) {
+
+							// No data for 'stall-time' seconds, abandon the connection.
+							Logger::String{"Transfer of '",url,"' has stalled, reconnecting"}.warning("download");
+							state->abandoned = true;
+							stalled = true;
+							break;
+
+						}
+
+						// Report progress from this thread, the transfer one can't touch the dialog or the meter.
+						unsigned long long current = offset;
+						unsigned long long length = info.length;
+						lock.unlock();
+						progress(current,length);
+						lock.lock();
+
+					}
+				}
+
+				if(state->abandoned) {
+					// The thread doesn't touch the local data anymore, it ends with the connection.
+					transfer.detach();
+				} else {
+					transfer.join();
+				}
+
+				progress(offset,info.length);
+
+				if(state->failed) {
+
+					try {
+
+						rethrow_exception(state->failed);
+
+					} catch(const std::exception &e) {
+
+						if(fatal) {
+							rethrow_exception(fatal);
+						}
+
+						if(!stalled) {
+							Logger::String{"Transfer of '",url,"' has failed at offset ",offset,": ",e.what()}.warning("download");
+						}
+
+					}
+
+				} else if(!stalled) {
+
+					complete = true;
+
+				}
+
+				if(complete) {
+					break;
+				}
+
+				if(offset > start) {
+					failures = 0;
+				} else if(++failures > retries) {
+					throw runtime_error(Logger::Message(_("Unable to download {}"),url));
+				}
+
+				sleep(1);
+
+			}
+
+		} catch(...) {
+
+			::close(fd);
+
+			if(!persistent) {
+				remove(partial.c_str());
+				remove(infofile.c_str());
+			}
+
+			throw;
+
+		}
+
+		::close(fd);
+
+		if(checksum) {
+			try {
+				checksum->verify(url);
+			} catch(...) {
+				// Bad contents, dont keep it for resume.
+				remove(partial.c_str());
+				remove(infofile.c_str());
+				throw;
+			}
+		}
+
+		if(rename(partial.c_str(),filename)) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		remove(infofile.c_str());
+
+	}
+
+ }
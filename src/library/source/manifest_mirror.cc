@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/source.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <private/mirror.h>
+ #include <private/cache.h>
+ #include <string>
+ #include <vector>
+ #include <mutex>
+ #include <unordered_map>
+ #include <sstream>
+ #include <cstdlib>
+ #include <cctype>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Manifest file entry.
+	struct ManifestItem {
+		std::string path;					///< @brief Path relative to the repository URL (with leading '/', URL escaped).
+		unsigned long long length = 0;
+		time_t mtime = 0;
+		std::string sha256;
+	};
+
+	/// @brief Decode URL escapes (%20) on manifest path.
+	static std::string unescape(const char *str) {
+
+		std::string rc;
+
+		while(*str) {
+
+			if(*str == '%' && isxdigit(str[1]) && isxdigit(str[2])) {
+				char hex[3] = { str[1], str[2], 0 };
+				rc += (char) strtol(hex,NULL,16);
+				str += 3;
+			} else {
+				rc += *(str++);
+			}
+
+		}
+
+		return rc;
+
+	}
+
+	/// @brief Parse manifest line ('sha256<TAB>length<TAB>mtime<TAB>path').
+	static bool parse(const std::string &line, ManifestItem &item) {
+
+		if(line.empty() || line[0] == '#') {
+			return false;
+		}
+
+		std::istringstream fields{line};
+		std::string length, mtime;
+
+		if(!(std::getline(fields,item.sha256,'\t') && std::getline(fields,length,'\t') && std::getline(fields,mtime,'\t') && std::getline(fields,item.path))) {
+			throw runtime_error(Logger::Message(_("Invalid manifest line '{}'"),line));
+		}
+
+		if(item.sha256 == "-") {
+			item.sha256.clear();
+		}
+
+		item.length = std::stoull(length);
+		item.mtime = (time_t) std::stoll(mtime);
+
+		if(item.path.empty()) {
+			throw runtime_error(Logger::Message(_("Invalid manifest line '{}'"),line));
+		}
+
+		if(item.path[0] != '/') {
+			item.path.insert(0,1,'/');
+		}
+
+		return true;
+
+	}
+
+	/// @brief Get manifest, it's downloaded only once for all sources.
+	static std::shared_ptr<const std::vector<ManifestItem>> load(const std::string &url) {
+
+		static std::mutex guard;
+		static std::unordered_map<std::string,std::shared_ptr<const std::vector<ManifestItem>>> manifests;
+
+		lock_guard<mutex> lock(guard);
+
+		auto it = manifests.find(url);
+		if(it != manifests.end()) {
+			return it->second;
+		}
+
+		auto items = make_shared<std::vector<ManifestItem>>();
+		std::string line;
+
+		Cache::getInstance().text(url.c_str(),[&](const char *text, size_t length){
+
+			for(size_t ix = 0; ix < length; ix++) {
+
+				if(text[ix] == '\n') {
+					ManifestItem item;
+					if(parse(line,item)) {
+						items->push_back(item);
+					}
+					line.clear();
+				} else if(text[ix] != '\r') {
+					line += text[ix];
+				}
+
+			}
+
+		});
+
+		ManifestItem item;
+		if(parse(line,item)) {
+			items->push_back(item);
+		}
+
+		Logger::String{"Manifest '",url,"' has ",items->size()," file(s)"}.trace("manifest");
+
+		manifests[url] = items;
+		return items;
+
+	}
+
+	void Mirror::manifest(const char *path, const char *url, const char *base, const char *manifest, const std::function<void(const Entry &entry)> &call) {
+
+		std::string root{base};
+		while(!root.empty() && root[root.size()-1] == '/') {
+			root.resize(root.size()-1);
+		}
+
+		if(strncmp(url,root.c_str(),root.size())) {
+			throw runtime_error(Logger::Message(_("The url '{}' is not in the repository"),url));
+		}
+
+		// Folder path relative to the repository (with leading and trailing '/').
+		std::string folder{url+root.size()};
+		if(folder.empty() || folder[0] != '/') {
+			folder.insert(0,1,'/');
+		}
+
+		auto items = load(root + "/" + (manifest[0] == '/' ? manifest+1 : manifest));
+
+		for(const ManifestItem &item : *items) {
+
+			if(strncmp(item.path.c_str(),folder.c_str(),folder.size())) {
+				continue;
+			}
+
+			Entry entry;
+			entry.url = root + item.path;
+			entry.path = path + unescape(item.path.c_str()+folder.size());
+			entry.length = item.length;
+			entry.mtime = item.mtime;
+			entry.sha256 = item.sha256;
+
+			call(entry);
+
+		}
+
+	}
+
+ }
@@ -0,0 +1,385 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/download.h>
+ #include <reinstall/action.h>
+ #include <reinstall/checksum.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <pugixml.hpp>
+ #include <string>
+ #include <vector>
+ #include <deque>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <atomic>
+ #include <chrono>
+ #include <algorithm>
+ #include <cstdint>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	bool Download::metalink(const char *url, const char *filename, unsigned long long length, const std::function<void(double current, double total)> &progress) {
+
+		// Get metalink from server.
+		pugi::xml_document document;
+		{
+			std::string text;
+
+			try {
+
+				text = Protocol::WorkerFactory((string{url} + ".meta4").c_str())->get();
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"No metalink for '",url,"': ",e.what()}.trace("download");
+				return false;
+
+			}
+
+			if(!document.load_string(text.c_str())) {
+				Logger::String{"Invalid metalink for '",url,"'"}.trace("download");
+				return false;
+			}
+		}
+
+		// Search for the file node.
+		const char *name = strrchr(url,'/');
+		name = (name ? name+1 : url);
+
+		pugi::xml_node file;
+		for(pugi::xml_node node = document.child("metalink").child("file"); node; node = node.next_sibling("file")) {
+			if(!strcmp(node.attribute("name").as_string(),name)) {
+				file = node;
+				break;
+			}
+		}
+
+		if(!file) {
+			Logger::String{"Metalink has no entry for '",name,"'"}.trace("download");
+			return false;
+		}
+
+		unsigned long long size = file.child("size").text().as_ullong(0);
+		if(size && size != length) {
+			Logger::String{"Metalink size for '",name,"' doesnt match the server length"}.warning("download");
+			return false;
+		}
+
+		// Get pieces.
+		pugi::xml_node pieces = file.child("pieces");
+		unsigned long long piecelength = pieces.attribute("length").as_ullong(0);
+		const char *type = pieces.attribute("type").as_string("sha-256");
+
+		std::vector<std::string> hashes;
+		for(pugi::xml_node hash = pieces.child("hash"); hash; hash = hash.next_sibling("hash")) {
+			hashes.emplace_back(hash.text().as_string());
+		}
+
+		if(!piecelength || hashes.size() != ((length + piecelength - 1) / piecelength)) {
+			Logger::String{"Metalink for '",name,"' has no usable piece hashes"}.trace("download");
+			return false;
+		}
+
+		// Get mirrors, ordered by priority.
+		struct Mirror {
+			std::string url;
+			unsigned int priority;
+		};
+
+		std::vector<Mirror> mirrors;
+		for(pugi::xml_node node = file.child("url"); node; node = node.next_sibling("url")) {
+			const char *str = node.text().as_string();
+			if(*str) {
+				mirrors.push_back(Mirror{str,node.attribute("priority").as_uint(999999)});
+			}
+		}
+
+		std::stable_sort(mirrors.begin(),mirrors.end(),[](const Mirror &a, const Mirror &b){
+			return a.priority < b.priority;
+		});
+
+		size_t limit = Config::Value<unsigned int>("download","metalink-mirrors",8);
+		if(mirrors.size() > limit) {
+			mirrors.resize(limit);
+		}
+
+		if(mirrors.empty()) {
+			Logger::String{"Metalink for '",name,"' has no mirrors"}.trace("download");
+			return false;
+		}
+
+		unsigned int workers = Config::Value<unsigned int>("download","segments",4);
+		unsigned int retries = Config::Value<unsigned int>("download","retries",5);
+
+		if(workers < 1) {
+			workers = 1;
+		}
+
+		if(workers > hashes.size()) {
+			workers = hashes.size();
+		}
+
+		Logger::String{
+			"Downloading '",url,"' from ",mirrors.size()," mirror(s) in ",hashes.size()," piece(s) using ",workers," connection(s)"
+		}.info("download");
+
+		int fd = ::open(filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		try {
+			preallocate(fd,filename,length);
+		} catch(...) {
+			::close(fd);
+			remove(filename);
+			throw;
+		}
+
+		std::mutex guard;
+		std::condition_variable changed;
+		std::exception_ptr failed;
+		std::atomic<unsigned long long> received{0};
+
+		/// @brief Pieces waiting for download.
+		std::deque<size_t> queue;
+
+		/// @brief Mirrors with corrupted data for each piece.
+		std::vector<std::vector<bool>> corrupted(hashes.size(),std::vector<bool>(mirrors.size(),false));
+
+		/// @brief Failed transfers for each piece.
+		std::vector<unsigned int> attempts(hashes.size(),0);
+
+		/// @brief Pieces being downloaded.
+		size_t inflight = 0;
+
+		unsigned int active = workers;
+
+		for(size_t piece = 0; piece < hashes.size(); piece++) {
+			queue.push_back(piece);
+		}
+
+		std::vector<std::thread> threads;
+
+		for(unsigned int id = 0; id < workers; id++) {
+
+			threads.emplace_back([&,id](){
+
+				size_t mirror = id % mirrors.size();
+				unsigned int failures = 0;
+				std::vector<uint8_t> buffer;
+
+				while(true) {
+
+					size_t piece = hashes.size();
+
+					// Get next piece.
+					{
+						unique_lock<mutex> lock(guard);
+
+						changed.wait(lock,[&]{
+							return failed || !queue.empty() || !inflight;
+						});
+
+						if(failed || queue.empty()) {
+							break;
+						}
+
+						auto it = std::find_if(queue.begin(),queue.end(),[&](size_t p){
+							return !corrupted[p][mirror];
+						});
+
+						if(it == queue.end()) {
+
+							// All pending pieces are corrupted on this mirror, use another one.
+							for(size_t ix = 1; ix < mirrors.size(); ix++) {
+								size_t next = (mirror + ix) % mirrors.size();
+								if(std::any_of(queue.begin(),queue.end(),[&](size_t p){ return !corrupted[p][next]; })) {
+									mirror = next;
+									break;
+								}
+							}
+							continue;
+						}
+
+						piece = *it;
+						queue.erase(it);
+						inflight++;
+					}
+
+					unsigned long long from = piece * piecelength;
+					unsigned long long to = std::min(length, from + piecelength) - 1;
+					size_t size = (size_t) (to - from + 1);
+
+					// Fetch piece from mirror.
+					bool valid = false;
+
+					try {
+
+						buffer.clear();
+						buffer.reserve(size);
+
+						auto worker = Protocol::WorkerFactory(mirrors[mirror].url.c_str());
+						worker->request("Range") = (string{"bytes="} + std::to_string(from) + "-" + std::to_string(to));
+
+						bool first = true;
+						worker->save([&](unsigned long long, unsigned long long, const void *buf, size_t bytes){
+
+							if(first) {
+								first = false;
+								if(worker->response("Content-Range").empty()) {
+									throw runtime_error(_("Server has ignored the range request"));
+								}
+							}
+
+							bytes = std::min(bytes,size - buffer.size());
+							buffer.insert(buffer.end(),(const uint8_t *) buf,((const uint8_t *) buf) + bytes);
+
+							return buffer.size() < size;
+
+						});
+
+						if(buffer.size() != size) {
+							throw runtime_error(_("Unexpected length"));
+						}
+
+						Checksum checksum{hashes[piece].c_str(),type};
+						checksum.update(buffer.data(),buffer.size());
+						valid = checksum.test();
+
+						if(!valid) {
+
+							Logger::String{"Piece ",piece," from '",mirrors[mirror].url,"' is corrupted"}.warning("download");
+
+							lock_guard<mutex> lock(guard);
+							corrupted[piece][mirror] = true;
+
+							if(std::all_of(corrupted[piece].begin(),corrupted[piece].end(),[](bool c){ return c; })) {
+								if(!failed) {
+									failed = make_exception_ptr(runtime_error(Logger::Message(_("Piece {} is corrupted on all mirrors"),piece)));
+								}
+							}
+
+						}
+
+						failures = 0;
+
+					} catch(const std::exception &e) {
+
+						Logger::String{"Piece ",piece," from '",mirrors[mirror].url,"' has failed: ",e.what()}.warning("download");
+
+						{
+							lock_guard<mutex> lock(guard);
+							if(++attempts[piece] > (retries * mirrors.size()) && !failed) {
+								failed = make_exception_ptr(runtime_error(Logger::Message(_("Unable to download {}"),url)));
+							}
+						}
+
+						if(++failures >= retries) {
+							// Too many errors, try another mirror.
+							mirror = (mirror + 1) % mirrors.size();
+							failures = 0;
+						}
+
+					}
+
+					if(valid) {
+
+						if(pwrite(fd,buffer.data(),size,from) != (ssize_t) size) {
+							lock_guard<mutex> lock(guard);
+							if(!failed) {
+								failed = make_exception_ptr(system_error(errno,system_category(),filename));
+							}
+						} else {
+							received += size;
+						}
+
+					}
+
+					{
+						lock_guard<mutex> lock(guard);
+						inflight--;
+						if(!valid) {
+							// Get it again, on another mirror if corrupted.
+							queue.push_front(piece);
+						}
+					}
+					changed.notify_all();
+
+					if(!valid && failures) {
+						std::this_thread::sleep_for(std::chrono::seconds(1));
+					}
+
+				}
+
+				{
+					lock_guard<mutex> lock(guard);
+					active--;
+				}
+				changed.notify_all();
+
+			});
+
+		}
+
+		// Report aggregated progress until all pieces are complete.
+		{
+			unique_lock<mutex> lock(guard);
+			while(active) {
+				changed.wait_for(lock,std::chrono::milliseconds(250));
+				progress((double) received, (double) length);
+			}
+		}
+
+		for(auto &thread : threads) {
+			thread.join();
+		}
+
+		::close(fd);
+
+		if(failed) {
+			remove(filename);
+			rethrow_exception(failed);
+		}
+
+		if(received != length) {
+			remove(filename);
+			throw runtime_error(Logger::Message(_("Unexpected length downloading {}"),url));
+		}
+
+		return true;
+
+	}
+
+ }
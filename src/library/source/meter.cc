@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/meter.h>
+ #include <reinstall/dialogs/progress.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <memory>
+ #include <string>
+ #include <cstdio>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	static thread_local bool worker = false;
+
+	Meter::Background::Background() noexcept : saved{worker} {
+		worker = true;
+	}
+
+	Meter::Background::~Background() noexcept {
+		worker = saved;
+	}
+
+	bool Meter::background() noexcept {
+		return worker;
+	}
+
+	void Meter::Progress::set_title(const char *title) {
+		if(!worker) {
+			Dialog::Progress::getInstance().set_title(title);
+		}
+	}
+
+	void Meter::Progress::set_sub_title(const char *subtitle) {
+		if(!worker) {
+			Dialog::Progress::getInstance().set_sub_title(subtitle);
+		}
+	}
+
+	void Meter::Progress::set_url(const char *url) {
+		if(!worker) {
+			Dialog::Progress::getInstance().set_url(url);
+		}
+	}
+
+	void Meter::Progress::set_progress(double current, double total) {
+		if(!worker) {
+			Dialog::Progress::getInstance().set_progress(current,total);
+		}
+	}
+
+	void Meter::Progress::pulse() {
+		if(!worker) {
+			Dialog::Progress::getInstance().pulse();
+		}
+	}
+
+	Meter & Meter::getInstance() {
+		static Meter instance;
+		return instance;
+	}
+
+	std::string Meter::format(unsigned long long bytes) {
+
+		static const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+
+		double value = (double) bytes;
+		size_t unit = 0;
+
+		while(value >= 1024.0 && unit < (sizeof(units)/sizeof(units[0]))-1) {
+			value /= 1024.0;
+			unit++;
+		}
+
+		char buffer[40];
+		snprintf(buffer,sizeof(buffer),(unit ? "%.1f %s" : "%.0f %s"),value,units[unit]);
+		return buffer;
+
+	}
+
+	void Meter::start() {
+		lock_guard<mutex> lock(guard);
+		active = true;
+		total = received = 0;
+		count = current = 0;
+		started = time(0);
+		updated = 0;
+	}
+
+	void Meter::set_total(unsigned long long t, size_t c) {
+		lock_guard<mutex> lock(guard);
+		total = t;
+		count = c;
+	}
+
+	void Meter::stop() {
+		lock_guard<mutex> lock(guard);
+		active = false;
+		total = 0;
+		count = 0;
+		Dialog::Progress::getInstance().set_step("");
+	}
+
+	void Meter::add(unsigned long long bytes) {
+
+		lock_guard<mutex> lock(guard);
+
+		if(!active) {
+			return;
+		}
+
+		received += bytes;
+
+		if(worker) {
+			// Shown by the action thread.
+			pending = true;
+			return;
+		}
+
+		// Throttle dialog updates.
+		time_t now = time(0);
+		if(total && now != updated) {
+			updated = now;
+			refresh();
+		}
+
+	}
+
+	void Meter::update() {
+
+		lock_guard<mutex> lock(guard);
+
+		if(!(active && pending && total) || worker) {
+			return;
+		}
+
+		time_t now = time(0);
+		if(now != updated) {
+			updated = now;
+			refresh();
+		}
+
+	}
+
+	void Meter::set_count(size_t c) {
+		lock_guard<mutex> lock(guard);
+		current = c;
+		if(total) {
+			refresh();
+		} else {
+			Dialog::Progress::getInstance().set_count(current,count);
+		}
+	}
+
+	void Meter::refresh() {
+
+		pending = false;
+
+		std::string text;
+
+		if(current && count) {
+			text = Logger::Message{_("{} of {}"),current,count};
+			text += " - ";
+		}
+
+		if(received > total) {
+			// Bigger than expected.
+			total = received;
+		}
+
+		text += Logger::Message{_("{} of {}"),format(received),format(total)};
+
+		time_t elapsed = time(0) - started;
+		if(elapsed > 0 && received && received < total) {
+
+			unsigned long long rate = received / elapsed;
+			if(rate) {
+				unsigned long long eta = (total - received) / rate;
+				if(eta >= 60) {
+					text += Logger::Message{_(", {} min left"),(eta + 59) / 60};
+				} else {
+					text += Logger::Message{_(", {} s left"),eta};
+				}
+			}
+
+		}
+
+		Dialog::Progress::getInstance().set_step(text.c_str());
+
+	}
+
+	std::function<void(double current, double total)> Meter::wrap(const std::function<void(double current, double total)> &progress) {
+
+		auto last = make_shared<double>(0);
+
+		return [progress,last](double current, double total) {
+
+			progress(current,total);
+
+			// Restarted transfers are counted again only after the previous position.
+			if(current > *last) {
+				getInstance().add((unsigned long long) (current - *last));
+				*last = current;
+			}
+
+		};
+
+	}
+
+ }
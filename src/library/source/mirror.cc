@@ -26,13 +26,144 @@
  #include <udjat/tools/logger.h>
  #include <udjat/tools/intl.h>
  #include <udjat/tools/file.h>
+ #include <udjat/tools/quark.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/threadpool.h>
  #include <private/mirror.h>
+ #include <private/cache.h>
+ #include <private/workqueue.h>
+ #include <private/meter.h>
+ #include <ctime>
 
  using namespace std;
  using namespace Udjat;
 
  namespace Reinstall {
 
+	/// @brief Folder index, subfolders are loaded by their own tasks.
+	struct Folder {
+		std::vector<Mirror::Entry> entries;
+		std::vector<std::shared_ptr<Source>> sources;	///< @brief Source for every file entry.
+		std::vector<std::shared_ptr<Folder>> children;	///< @brief Subfolder for every folder entry.
+	};
+
+	using Factory = std::function<std::shared_ptr<Source>(const Mirror::Entry &entry)>;
+
+	static void load(WorkQueue &queue, WorkQueue::Group &group, Repository::Layout layout, const Factory &factory, std::shared_ptr<Folder> folder, const std::string &path, const std::string &url) {
+
+		// Handle entries while the index is being parsed; files are created (and prefetched)
+		// and subfolders are queued before the end of the listing.
+		auto append = [&](const Mirror::Entry &entry) {
+
+			folder->entries.push_back(entry);
+
+			if(entry.folder) {
+
+				auto child = make_shared<Folder>();
+				folder->sources.emplace_back();
+				folder->children.push_back(child);
+
+				std::string p{entry.path}, u{entry.url};
+				queue.push(group,[&queue,&group,layout,&factory,child,p,u](){
+					load(queue,group,layout,factory,child,p,u);
+				});
+
+			} else {
+
+				folder->sources.push_back(factory(entry));
+				folder->children.emplace_back();
+
+			}
+
+		};
+
+		switch(layout) {
+		case Repository::ApacheLayout:
+			debug("Loading contents from '",url.c_str(),"' in apache format");
+			Mirror::apache(path.c_str(),url.c_str(),append);
+			break;
+
+		case Repository::MirrorCacheLayout:
+			debug("Loading contents from '",url.c_str(),"' in MirrorCache format");
+			Mirror::mirrorcache(path.c_str(),url.c_str(),append);
+			break;
+
+		default:
+			throw runtime_error("The repository layout is invalid");
+		}
+
+	}
+
+	/// @brief Append folder files in index order (as a depth-first walk).
+	static void append(const Folder &folder, std::vector<std::shared_ptr<Source>> &contents, std::vector<Mirror::Entry> &files) {
+
+		for(size_t ix = 0; ix < folder.entries.size(); ix++) {
+
+			if(folder.children[ix]) {
+				append(*folder.children[ix],contents,files);
+				continue;
+			}
+
+			if(folder.sources[ix]) {
+				contents.push_back(folder.sources[ix]);
+			}
+
+			files.push_back(folder.entries[ix]);
+
+		}
+
+	}
+
+	void Mirror::expand(const char *path, const char *url, Repository::Layout layout, const Factory &factory, std::vector<std::shared_ptr<Source>> &contents, std::vector<Entry> &files) {
+
+		// Use the running queue when called from a task, subfolders shares the same threads.
+		WorkQueue *queue = WorkQueue::current();
+		std::unique_ptr<WorkQueue> local;
+
+		if(!queue) {
+			local.reset(new WorkQueue());
+			queue = local.get();
+		}
+
+		auto root = make_shared<Folder>();
+		WorkQueue::Group group;
+
+		try {
+			load(*queue,group,layout,factory,root,path,url);
+		} catch(...) {
+			// Wait for the subfolders already queued, they reference the factory.
+			try {
+				queue->wait(group);
+			} catch(...) {
+			}
+			throw;
+		}
+
+		queue->wait(group);
+
+		append(*root,contents,files);
+
+	}
+
+	/// @brief Build cached listing from folder files.
+	static Cache::Listing ListingFactory(const std::vector<Mirror::Entry> &files) {
+
+		Cache::Listing listing;
+		listing.updated = time(0);
+
+		for(const Mirror::Entry &file : files) {
+			Cache::Listing::Item item;
+			item.url = file.url;
+			item.path = file.path;
+			item.length = file.length;
+			item.mtime = file.mtime;
+			listing.items.push_back(item);
+		}
+
+		return listing;
+
+	}
+
 	bool Source::contents(const Action &action, std::vector<std::shared_ptr<Source>> &contents) {
 
 		URL url{this->url};
@@ -54,10 +185,18 @@
 		}
 
 		if(message && *message) {
-			Dialog::Progress::getInstance().set_title(message);
+			Meter::Progress{}.set_title(message);
 		}
 
-		if(strncasecmp(url.c_str(),"file://",7) == 0) {
+		if(strncasecmp(url.c_str(),"file://",7) == 0 && action.graft()) {
+
+			// The builder inserts the whole folder.
+			Logger::String{"Grafting '",url.c_str(),"' on '",path,"'"}.trace(name());
+			auto source = std::make_shared<Source>(this->name(),Quark{url.c_str()}.c_str(),path);
+			source->cache = cache;
+			contents.push_back(source);
+
+		} else if(strncasecmp(url.c_str(),"file://",7) == 0) {
 
 			const char *path = url.c_str()+7;
 
@@ -71,7 +210,9 @@
 				String local{this->path,file.c_str()+strlen(path)};
 
 				debug(remote);
-				contents.push_back(std::make_shared<Source>(this->name(),remote.c_str(),local.c_str()));
+				auto source = std::make_shared<Source>(this->name(),remote.c_str(),local.c_str());
+				source->cache = cache;
+				contents.push_back(source);
 
 				return false;
 
@@ -80,25 +221,119 @@
 		} else {
 
 			Repository::Layout layout = Repository::ApacheLayout;
-			if(repository && *repository) {
-				layout = action.repository(repository)->layout;
+			std::shared_ptr<Repository> repository;
+			if(this->repository && *this->repository) {
+				repository = action.repository(this->repository);
+				layout = repository->layout;
+			}
+
+			Meter::Progress{}.set_url(url.c_str());
+
+			// Create file source as soon as it's listed, start the download while loading.
+			auto factory = [this,&action,repository](const Mirror::Entry &entry) {
+
+				Logger::String {
+					entry.url," -> ",entry.path
+				}.trace(name());
+
+				auto source = std::make_shared<Source>(name(),entry.url.c_str(),entry.path.c_str());
+				source->length = entry.length;
+				source->mtime = entry.mtime;
+
+				if(!entry.sha256.empty() && !*source->checksum.sha256) {
+					source->checksum.sha256 = Quark{entry.sha256}.c_str();
+				}
+
+				// Expanded files inherits the cache option.
+				source->cache = cache;
+
+				// Route expanded files to the local copy or fastest mirror.
+				if(repository) {
+					source->route(*repository);
+				}
+
+				action.prefetch(source);
+				return source;
+
+			};
+
+			if(layout == Repository::ManifestLayout) {
+
+				// The repository has a file list, no need to crawl.
+				Mirror::manifest(path,url.c_str(),repository->get_url(true).c_str(),repository->manifest,[&contents,&factory](const Mirror::Entry &entry){
+					contents.push_back(factory(entry));
+				});
+
+				debug("Source ",name()," was loaded from manifest");
+				return true;
+
 			}
 
-			Dialog::Progress::getInstance().set_url(url.c_str());
+			Cache::Listing listing;
+			bool cached = false;
+
+			if(listings && Cache::getInstance().load(url.c_str(),path,listing)) {
+
+				time_t age = time(0) - listing.updated;
+
+				if(age < (time_t) Config::Value<unsigned int>("cache","listing-ttl",3600)) {
+
+					Logger::String{"Using cached listing of '",url.c_str(),"'"}.trace(name());
+					cached = true;
+
+				} else if(age >= (time_t) Config::Value<unsigned int>("cache","listing-max-age",86400)) {
+
+					// Too old, files can be removed from the repository; get it now.
+					Logger::String{"Cached listing of '",url.c_str(),"' is too old, reloading"}.trace(name());
+
+				} else if(Config::Value<bool>("cache","listing-refresh",true)) {
+
+					// Stale listing, use it now and refresh in background for the next run.
+					Logger::String{"Using stale listing of '",url.c_str(),"', refreshing in background"}.trace(name());
+					cached = true;
 
-			switch(layout) {
-			case Repository::ApacheLayout:
-				debug("Loading contents from '",url.c_str(),"' in apache format");
-				Mirror::apache(name(),path,url.c_str(),contents);
-				break;
+					std::string n{name()}, u{url.c_str()}, p{path};
+					Udjat::ThreadPool::getInstance().push([n,u,p,layout](){
+						try {
+							std::vector<std::shared_ptr<Source>> refreshed;
+							std::vector<Mirror::Entry> files;
+							Mirror::expand(p.c_str(),u.c_str(),layout,[](const Mirror::Entry &){
+								return std::shared_ptr<Source>();
+							},refreshed,files);
+							Cache::getInstance().save(u.c_str(),p.c_str(),ListingFactory(files));
+						} catch(const std::exception &e) {
+							Logger::String{"Cant refresh listing of '",u,"': ",e.what()}.warning(n.c_str());
+						}
+					});
 
-			case Repository::MirrorCacheLayout:
-				debug("Loading contents from '",url.c_str(),"' in MirrorCache format");
-				Mirror::mirrorcache(name(),path,url.c_str(),contents);
-				break;
+				}
+
+			}
+
+			if(cached) {
+
+				for(const Cache::Listing::Item &item : listing.items) {
+					Mirror::Entry entry;
+					entry.url = item.url;
+					entry.path = item.path;
+					entry.length = item.length;
+					entry.mtime = item.mtime;
+					contents.push_back(factory(entry));
+				}
+
+			} else {
+
+				std::vector<Mirror::Entry> files;
+				Mirror::expand(path,url.c_str(),layout,factory,contents,files);
+
+				if(listings) {
+					try {
+						Cache::getInstance().save(url.c_str(),path,ListingFactory(files));
+					} catch(const std::exception &e) {
+						Logger::String{"Cant save listing of '",url.c_str(),"': ",e.what()}.warning(name());
+					}
+				}
 
-			default:
-				throw runtime_error("The repository layout is invalid");
 			}
 
 		}
@@ -25,58 +25,178 @@
  #include <udjat/tools/logger.h>
  #include <udjat/tools/intl.h>
  #include <private/mirror.h>
+ #include <private/cache.h>
  #include <json/json.h>
+ #include <cctype>
 
  using namespace std;
  using namespace Udjat;
 
  namespace Reinstall {
 
-	void Mirror::mirrorcache(const char *name, const char *path, const char *url, std::vector<std::shared_ptr<Source>> &contents) {
+	/// @brief Incremental scanner for the rows of MirrorCache 'data' array.
+	class UDJAT_PRIVATE RowScanner {
+	private:
+		std::string text;			///< @brief Text before the array or the current row.
+		bool started = false;		///< @brief Inside the 'data' array?
+		bool finished = false;		///< @brief Array is complete.
+		unsigned int depth = 0;
+		bool quoted = false;
+		bool escaped = false;
+
+		/// @brief Search for the start of the array, remove the text before it.
+		bool start() {
+
+			auto pos = text.find("\"data\"");
+			if(pos == string::npos) {
+				if(text.size() > 6) {
+					text.erase(0,text.size()-6);
+				}
+				return false;
+			}
+
+			pos += 6;
+			while(pos < text.size() && (isspace(text[pos]) || text[pos] == ':')) {
+				pos++;
+			}
+
+			if(pos >= text.size()) {
+				return false;
+			}
+
+			if(text[pos] != '[') {
+				throw runtime_error("Unexpected JSON format");
+			}
+
+			text.erase(0,pos+1);
+			return true;
+
+		}
+
+	public:
 
-		Json::Value value;
+		/// @brief Parse block, call 'row' for every complete row.
+		void parse(const char *buf, size_t length, const std::function<void(const Json::Value &row)> &row) {
 
-		// Load JSON value.
-		{
-			string table = Protocol::WorkerFactory( (string{url} + "?jsontable").c_str() )->get();
+			size_t ix = 0;
 
-			Json::CharReaderBuilder builder;
-			JSONCPP_STRING err;
+			if(!started) {
+				text.append(buf,length);
+				if(!(started = start())) {
+					return;
+				}
+				// Scan the remaining text.
+				std::string remaining;
+				remaining.swap(text);
+				parse(remaining.c_str(),remaining.size(),row);
+				return;
+			}
 
-			const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+			for(ix = 0; ix < length && !finished; ix++) {
+
+				char chr = buf[ix];
+
+				if(depth) {
+					text += chr;
+				}
+
+				if(quoted) {
+					if(escaped) {
+						escaped = false;
+					} else if(chr == '\\') {
+						escaped = true;
+					} else if(chr == '"') {
+						quoted = false;
+					}
+					continue;
+				}
+
+				switch(chr) {
+				case '"':
+					quoted = true;
+					break;
+
+				case '{':
+				case '[':
+					if(!depth++) {
+						text = chr;
+					}
+					break;
+
+				case '}':
+				case ']':
+					if(!depth) {
+						// End of 'data' array.
+						finished = true;
+					} else if(!--depth) {
+
+						Json::Value value;
+						Json::CharReaderBuilder builder;
+						JSONCPP_STRING err;
+
+						const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+						if (!reader->parse(text.c_str(), text.c_str()+text.size(), &value, &err)) {
+							throw runtime_error(err);
+						}
+
+						text.clear();
+						row(value);
+
+					}
+					break;
+				}
 
-			const char *text = table.c_str();
-			if (!reader->parse(text, text+strlen(text), &value, &err)) {
-				throw runtime_error(err);
 			}
+
+		}
+
+		inline bool complete() const noexcept {
+			return finished;
 		}
 
-		for(Json::Value &item : value["data"]) {
+	};
 
-			std::string link{item["name"].asCString()};
+	void Mirror::mirrorcache(const char *path, const char *url, const std::function<void(const Entry &entry)> &call) {
+
+		RowScanner scanner;
+
+		auto emit = [&](const Json::Value &item) {
+
+			if(!item["name"].isString()) {
+				return;
+			}
+
+			std::string link{item["name"].asString()};
 
 			if(link.empty()) {
-				continue;
+				return;
 			}
 
-			string remote = url + link;
-			string local = path + link;
+			Entry entry;
+			entry.url = url + link;
+			entry.path = path + link;
+			entry.folder = (entry.url[entry.url.size()-1] == '/');
 
-			if(remote[remote.size()-1] == '/') {
+			// Keep file info for the listing cache.
+			if(item["size"].isIntegral()) {
+				entry.length = item["size"].asUInt64();
+			}
 
-				// Its a folder, expand it.
-				mirrorcache(name,local.c_str(),remote.c_str(),contents);
+			if(item["mtime"].isIntegral()) {
+				entry.mtime = (time_t) item["mtime"].asInt64();
+			}
 
-			} else {
+			call(entry);
 
-				// Its a file, append in the content list.
-				Logger::String {
-					remote," -> ",local
-				}.trace(name);
+		};
 
-				contents.push_back(std::make_shared<Source>(name,remote.c_str(),local.c_str()));
-			}
+		// Parse rows while receiving the table.
+		Cache::getInstance().text( (string{url} + "?jsontable").c_str(), [&](const char *text, size_t length){
+			scanner.parse(text,length,emit);
+		});
 
+		if(!scanner.complete()) {
+			throw runtime_error(Logger::Message(_("Unable to parse file list from {}"),url));
 		}
 
 	}
@@ -26,15 +26,73 @@
  #include <udjat/tools/intl.h>
  #include <udjat/tools/logger.h>
  #include <udjat/tools/file.h>
+ #include <private/cache.h>
+ #include <private/download.h>
+ #include <private/meter.h>
+ #include <private/singleflight.h>
+ #include <udjat/tools/configuration.h>
+ #include <reinstall/action.h>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
 
  using namespace std;
  using namespace Udjat;
 
  namespace Reinstall {
 
+	void Source::write(const char *filename) const {
+
+		int fd = ::open(filename,O_WRONLY|O_CREAT|O_TRUNC,memory.mode);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		const char *ptr = memory.contents->c_str();
+		size_t length = memory.contents->size();
+
+		while(length) {
+
+			ssize_t bytes = ::write(fd,ptr,length);
+			if(bytes < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				int err = errno;
+				::close(fd);
+				throw system_error(err,system_category(),filename);
+			}
+
+			ptr += bytes;
+			length -= bytes;
+
+		}
+
+		if(fchmod(fd,memory.mode) || ::close(fd)) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+	}
+
 	const char * Source::filename(bool rw) {
 
 		if(!rw) {
+
+			if(filenames.saved.empty() && memory.contents) {
+
+				// In memory, the caller needs a file.
+				if(filenames.temp.empty()) {
+					filenames.temp = File::Temporary::create();
+				}
+				write(filenames.temp.c_str());
+				filenames.saved = filenames.temp;
+
+			}
+
 			return filenames.saved.c_str();
 		}
 
@@ -45,6 +103,9 @@
 			filenames.saved.clear();
 			save(filenames.temp.c_str());
 
+			// The file will be changed, the memory contents are not valid anymore.
+			memory.contents.reset();
+
 		}
 
 		return filenames.saved.c_str();
@@ -64,7 +125,7 @@
 		}
 
 
-		Dialog::Progress &progress = Dialog::Progress::getInstance();
+		Meter::Progress progress;
 
 		if(message && *message) {
 			progress.set_sub_title(message);
@@ -72,18 +133,148 @@
 
 		progress.set_url(url);
 
-		Protocol::WorkerFactory(this->url)->save([&progress,&write](unsigned long long current, unsigned long long total, const void *buf, size_t length){
+		if(memory.contents) {
+
+			// Already in memory.
+			write(memory.contents->c_str(),memory.contents->size());
+			progress.set_progress(memory.contents->size(),memory.contents->size());
+			return;
+
+		}
+
+		if(!filenames.saved.empty()) {
+
+			// Already downloaded, read from the local file.
+			int fd = ::open(filenames.saved.c_str(),O_RDONLY);
+			if(fd < 0) {
+				throw system_error(errno,system_category(),filenames.saved);
+			}
+
+			try {
+
+				struct stat st;
+				if(fstat(fd,&st)) {
+					throw system_error(errno,system_category(),filenames.saved);
+				}
+
+				unsigned long long current = 0;
+				char buffer[16384];
+				while(current < (unsigned long long) st.st_size) {
+
+					ssize_t bytes = ::read(fd,buffer,sizeof(buffer));
+					if(bytes < 0) {
+						throw system_error(errno,system_category(),filenames.saved);
+					} else if(bytes == 0) {
+						throw runtime_error(_("Unexpected EOF reading downloaded file"));
+					}
+
+					write(buffer,bytes);
+					current += bytes;
+					progress.set_progress(current,st.st_size);
+
+				}
+
+			} catch(...) {
+				::close(fd);
+				throw;
+			}
+
+			::close(fd);
+			return;
+
+		}
+
+		auto update = Meter::wrap([&progress](double current, double total){
 			progress.set_progress(current,total);
-			write(buf,length);
-			return true;
 		});
 
+		bool written = false;
+		auto stream = [this,&update,&write,&written](const char *url) {
+
+			auto checksum = ChecksumFactory();
+
+			Protocol::WorkerFactory(url)->save([&update,&write,&checksum,&written](unsigned long long current, unsigned long long total, const void *buf, size_t length){
+				update(current,total);
+				if(checksum) {
+					checksum->update(buf,length);
+				}
+				written = true;
+				write(buf,length);
+				return true;
+			});
+
+			if(checksum) {
+				checksum->verify(url);
+			}
+
+		};
+
+		try {
+
+			stream(url);
+
+		} catch(const std::exception &e) {
+
+			// The data already sent can't be taken back, retry only if nothing was written.
+			if(!*origin || written) {
+				throw;
+			}
+
+			Logger::String{"Cant get '",url,"' from mirror (",e.what(),"), trying '",origin,"'"}.warning(name());
+			stream(origin);
+
+		}
+
+	}
+
+	void Source::fetch(const std::function<void(const char *url)> &call) {
+
+		if(!*origin) {
+			call(url);
+			return;
+		}
+
+		try {
+
+			call(url);
+
+		} catch(const std::exception &e) {
+
+			Logger::String{"Cant get '",url,"' from mirror (",e.what(),"), trying '",origin,"'"}.warning(name());
+			call(origin);
+
+		}
+
 	}
 
  	void Source::save(const char *filename) {
 
+		if(memory.contents) {
+
+			// In memory, just write it.
+			write(filename);
+			if(filenames.saved.empty()) {
+				filenames.saved = filename;
+			}
+			return;
+
+		}
+
 		if(!filenames.saved.empty()) {
-			warning() << "Already downloaded" << endl;
+
+			if(filenames.saved == filename) {
+				warning() << "Already downloaded" << endl;
+				return;
+			}
+
+			// Already downloaded to another file, just copy it.
+			Meter::Progress progress;
+			progress.set_url(url);
+
+			Download::copy(filenames.saved.c_str(),filename,[&progress](double current, double total){
+				progress.set_progress(current,total);
+			});
+
 			return;
 		}
 
@@ -97,9 +288,15 @@
 			throw runtime_error(_("Unable to get source with relative URL"));
 		}
 
- 		filenames.saved = filename;
+		// Set the filename only after a successful transfer, a failed one must be retried.
+		download(filename);
+		filenames.saved = filename;
 
-		Dialog::Progress &progress = Dialog::Progress::getInstance();
+ 	}
+
+	void Source::download(const char *filename, bool persistent) {
+
+		Meter::Progress progress;
 
 		if(message && *message) {
 			progress.set_sub_title(message);
@@ -107,32 +304,53 @@
 
 		progress.set_url(url);
 
+		// Get the expected digest before the transfer, fail early if not available.
+		auto checksum = ((verified && strncasecmp(url,"file://",7) == 0) ? nullptr : ChecksumFactory());
+
  		if(strncasecmp(url,"file://",7) == 0) {
 
-			// It's a file, just copy it.
-			Udjat::File::copy(Udjat::URL{url}.ComponentsFactory().path.c_str(),filename,
-			[&progress](double current, double total){
+			// It's a file, copy it in the kernel.
+			std::string from{Udjat::URL{url}.ComponentsFactory().path};
+
+			Download::copy(from.c_str(),filename,[&progress](double current, double total){
 				progress.set_progress(current,total);
-				return true;
-			},true);
+			});
+
+			if(checksum) {
+
+				// Verify the copy, it's on the page cache.
+				try {
+					checksum->update(filename);
+					checksum->verify(url);
+				} catch(...) {
+					remove(filename);
+					throw;
+				}
+
+			}
 
  		} else {
 
-			// Not a file, download it.
-			Protocol::WorkerFactory(this->url)->save(filename,[&progress](double current, double total){
-				progress.set_progress(current,total);
-				return true;
-			},true);
+			// Not a file, download it; a failed mirror is retried from the repository with a fresh digest.
+			fetch([this,&progress,&checksum,filename,persistent](const char *url){
 
- 		}
+				if(url != this->url) {
+					checksum = ChecksumFactory();
+				}
+
+				Download::file(url,filename,Meter::wrap([&progress](double current, double total){
+					progress.set_progress(current,total);
+				}),persistent,checksum.get(),length);
 
+			});
 
+ 		}
 
  	}
 
 	void Source::save() {
 
-		if(!filenames.saved.empty()) {
+		if(saved()) {
 			warning() << "Already downloaded" << endl;
 			return;
 		}
@@ -148,11 +366,19 @@
 		}
 
 		if(strncasecmp(url,"file://",7) == 0) {
+
+			// The local copy of an hybrid repository was verified when routed.
+			auto checksum = (verified ? nullptr : ChecksumFactory());
+			if(checksum) {
+				checksum->update(url+7);
+				checksum->verify(url);
+			}
+
 			filenames.saved = (url + 7);
 			return;
 		}
 
-		Dialog::Progress &progress = Dialog::Progress::getInstance();
+		Meter::Progress progress;
 
 		auto worker = Protocol::WorkerFactory(this->url);
 
@@ -161,10 +387,67 @@
 		}
 		progress.set_url(worker->url().c_str());
 
-		// Download to temporary file.
-		filenames.temp = File::Temporary::create();
-		save(filenames.temp.c_str());
-		filenames.saved = filenames.temp;
+		unsigned long long limit = Action::getImageSize(Config::Value<string>("download","memory-threshold","256KB").c_str());
+
+		if(!cache && length && length <= limit) {
+
+			// Small file, keep it in memory.
+			auto update = Meter::wrap([&progress](double current, double total){
+				progress.set_progress(current,total);
+			});
+
+			std::shared_ptr<std::string> contents = make_shared<std::string>();
+			contents->reserve(length);
+
+			fetch([this,&worker,&update,&contents](const char *url){
+
+				auto checksum = ChecksumFactory();
+				contents->clear();
+
+				(url == this->url ? worker : Protocol::WorkerFactory(url))->save([&update,&checksum,&contents](unsigned long long current, unsigned long long total, const void *buf, size_t length){
+					update(current,total);
+					if(checksum) {
+						checksum->update(buf,length);
+					}
+					contents->append((const char *) buf,length);
+					return true;
+				});
+
+				if(checksum) {
+					checksum->verify(url);
+				}
+
+			});
+
+			set_contents(contents);
+			return;
+
+		}
+
+		// Other sources, templates or actions requesting the same URL share the transfer.
+		auto shared = SingleFlight::get(url,[this](const char *tempname){
+
+			if(cache) {
+
+				// Use the download cache.
+				std::string cached = Cache::getInstance().get(url,[this](const char *filename){
+					download(filename,true);
+				});
+
+				if(!cached.empty()) {
+					return cached;
+				}
+
+			}
+
+			// Download to temporary file.
+			save(tempname);
+			return string{tempname};
+
+		});
+
+		transfer = shared;
+		filenames.saved = shared->filename;
 
 	}
 
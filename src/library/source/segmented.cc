@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/download.h>
+ #include <private/cache.h>
+ #include <reinstall/action.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/intl.h>
+ #include <string>
+ #include <vector>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <atomic>
+ #include <chrono>
+ #include <ctime>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	void Download::file(const char *url, const char *filename, const std::function<void(double current, double total)> &progress, bool persistent, Checksum *checksum, unsigned long long length) {
+
+		unsigned int segments = Config::Value<unsigned int>("download","segments",4);
+		unsigned long long threshold = Action::getImageSize(Config::Value<string>("download","segment-threshold","64MB").c_str());
+
+		if(segments > 1 && !(length && length < threshold) && access((string{filename} + ".part").c_str(),F_OK)) {
+
+			// No partial data from a previous run, check if the file is large enough for a segmented download.
+			Cache::Validators validators;
+
+			if(length) {
+				// Length from the listing, no need for a HEAD; if the server ignores the ranges the segments fail.
+				validators.length = length;
+				validators.ranges = true;
+			} else {
+				validators = Cache::Validators{url};
+			}
+
+			if(validators.ranges && validators.length && validators.length >= threshold) {
+
+				bool complete = false;
+
+				if(Config::Value<bool>("download","metalink",true)) {
+
+					try {
+
+						complete = metalink(url,filename,validators.length,progress);
+
+					} catch(const std::exception &e) {
+
+						Logger::String{"Metalink download of '",url,"' has failed: ",e.what()}.warning("download");
+
+					}
+
+				}
+
+				if(!complete) {
+
+					try {
+
+						segmented(url,filename,validators.length,progress);
+						complete = true;
+
+					} catch(const std::exception &e) {
+
+						Logger::String{"Segmented download of '",url,"' has failed: ",e.what()}.warning("download");
+
+					}
+
+				}
+
+				if(complete) {
+
+					if(checksum) {
+
+						// Segments are written out of order, verify the complete file.
+						try {
+							checksum->update(filename);
+							checksum->verify(url);
+						} catch(...) {
+							remove(filename);
+							throw;
+						}
+
+					}
+
+					return;
+				}
+
+			}
+
+		}
+
+		resumable(url,filename,progress,persistent,checksum);
+
+	}
+
+	void Download::preallocate(int fd, const char *filename, unsigned long long length, bool resize) {
+
+#ifdef __linux__
+		if(!fallocate(fd,(resize ? 0 : FALLOC_FL_KEEP_SIZE),0,(off_t) length)) {
+			return;
+		}
+
+		if(errno == ENOSPC) {
+			throw system_error(errno,system_category(),filename);
+		}
+#endif // __linux__
+
+		// No fallocate() on this filesystem, just set the file size.
+		if(resize && ftruncate(fd,(off_t) length)) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+	}
+
+	void Download::segmented(const char *url, const char *filename, unsigned long long length, const std::function<void(double current, double total)> &progress) {
+
+		unsigned int segments = Config::Value<unsigned int>("download","segments",4);
+		unsigned int retries = Config::Value<unsigned int>("download","retries",5);
+		unsigned long long minrate = Action::getImageSize(Config::Value<string>("download","min-throughput","1KB").c_str());
+		time_t window = (time_t) Config::Value<unsigned int>("download","stall-time",30);
+
+		if(segments < 1) {
+			segments = 1;
+		}
+
+		int fd = ::open(filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if(fd < 0) {
+			throw system_error(errno,system_category(),filename);
+		}
+
+		// Preallocate the file, every segment will be written on its own region.
+		try {
+			preallocate(fd,filename,length);
+		} catch(...) {
+			::close(fd);
+			remove(filename);
+			throw;
+		}
+
+		Logger::String{"Downloading '",url,"' using ",segments," segment(s)"}.info("download");
+
+		std::mutex guard;
+		std::condition_variable changed;
+		std::exception_ptr failed;
+		std::atomic<unsigned long long> received{0};
+		std::atomic<bool> cancelled{false};
+		unsigned int active = segments;
+
+		std::vector<std::thread> threads;
+		unsigned long long size = length / segments;
+
+		for(unsigned int segment = 0; segment < segments; segment++) {
+
+			unsigned long long from = segment * size;
+			unsigned long long to = (segment+1 == segments ? length : from + size) - 1;
+
+			threads.emplace_back([&,from,to](){
+
+				unsigned long long offset = from;
+				unsigned int failures = 0;
+
+				try {
+
+					while(offset <= to && !cancelled) {
+
+						auto worker = Protocol::WorkerFactory(url);
+						worker->request("Range") = (string{"bytes="} + std::to_string(offset) + "-" + std::to_string(to));
+
+						unsigned long long start = offset;
+						bool first = true;
+						bool ignored = false;
+
+						struct {
+							time_t start;
+							unsigned long long bytes = 0;
+						} sample;
+
+						sample.start = time(0);
+
+						try {
+
+							worker->save([&](unsigned long long, unsigned long long, const void *buf, size_t bytes){
+
+								if(first) {
+									first = false;
+									if(worker->response("Content-Range").empty()) {
+										ignored = true;
+										throw runtime_error(_("Server has ignored the range request"));
+									}
+								}
+
+								if(cancelled) {
+									return false;
+								}
+
+								if(bytes > (to - offset + 1)) {
+									bytes = (size_t) (to - offset + 1);
+								}
+
+								if(pwrite(fd,buf,bytes,offset) != (ssize_t) bytes) {
+									throw system_error(errno,system_category(),filename);
+								}
+
+								offset += bytes;
+								received += bytes;
+
+								// Check for stalled transfer.
+								sample.bytes += bytes;
+								time_t now = time(0);
+								if((now - sample.start) >= window) {
+
+									if((sample.bytes / (now - sample.start)) < minrate) {
+										Logger::String{"Segment ",from,"-",to," of '",url,"' is below ",minrate," bytes/s, reconnecting"}.warning("download");
+										return false;
+									}
+
+									sample.start = now;
+									sample.bytes = 0;
+
+								}
+
+								return offset <= to;
+
+							});
+
+						} catch(const std::system_error &) {
+
+							throw;
+
+						} catch(const std::exception &e) {
+
+							if(ignored) {
+								throw;
+							}
+
+							Logger::String{"Segment ",from,"-",to," of '",url,"' has failed at offset ",offset,": ",e.what()}.warning("download");
+
+						}
+
+						if(offset > to || cancelled) {
+							break;
+						}
+
+						if(offset > start) {
+							failures = 0;
+						} else if(++failures > retries) {
+							throw runtime_error(Logger::Message(_("Unable to download {}"),url));
+						}
+
+						sleep(1);
+
+					}
+
+				} catch(...) {
+
+					lock_guard<mutex> lock(guard);
+					if(!failed) {
+						failed = current_exception();
+					}
+					cancelled = true;
+
+				}
+
+				{
+					lock_guard<mutex> lock(guard);
+					active--;
+				}
+				changed.notify_all();
+
+			});
+
+		}
+
+		// Report aggregated progress until all segments are complete.
+		{
+			unique_lock<mutex> lock(guard);
+			while(active) {
+				changed.wait_for(lock,std::chrono::milliseconds(250));
+				progress((double) received, (double) length);
+			}
+		}
+
+		for(auto &thread : threads) {
+			thread.join();
+		}
+
+		::close(fd);
+
+		if(failed) {
+			remove(filename);
+			rethrow_exception(failed);
+		}
+
+		if(received != length) {
+			remove(filename);
+			throw runtime_error(Logger::Message(_("Unexpected length downloading {}"),url));
+		}
+
+	}
+
+ }
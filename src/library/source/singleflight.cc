@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/singleflight.h>
+ #include <udjat/tools/file.h>
+ #include <udjat/tools/logger.h>
+ #include <unordered_map>
+ #include <mutex>
+ #include <condition_variable>
+ #include <cstdio>
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	static std::mutex guard;
+	static std::condition_variable changed;
+
+	/// @brief Transfers by URL.
+	static std::unordered_map<std::string,std::weak_ptr<SingleFlight::Transfer>> transfers;
+
+	SingleFlight::Transfer::~Transfer() {
+		if(!temp.empty()) {
+			remove(temp.c_str());
+		}
+	}
+
+	std::shared_ptr<SingleFlight::Transfer> SingleFlight::get(const char *url, const std::function<std::string(const char *tempname)> &fetch) {
+
+		std::shared_ptr<Transfer> transfer;
+
+		{
+			unique_lock<mutex> lock(guard);
+
+			auto it = transfers.find(url);
+			if(it != transfers.end()) {
+				transfer = it->second.lock();
+			}
+
+			if(transfer) {
+
+				if(!transfer->done) {
+					Logger::String{"Waiting for the transfer of '",url,"'"}.trace("download");
+					changed.wait(lock,[transfer]{
+						return transfer->done || transfer->failed;
+					});
+				}
+
+				if(transfer->failed) {
+					rethrow_exception(transfer->failed);
+				}
+
+				Logger::String{"Reusing the transfer of '",url,"'"}.trace("download");
+				return transfer;
+
+			}
+
+			// Forget the transfers without users.
+			for(auto entry = transfers.begin(); entry != transfers.end();) {
+				if(entry->second.expired()) {
+					entry = transfers.erase(entry);
+				} else {
+					entry++;
+				}
+			}
+
+			transfer = make_shared<Transfer>();
+			transfers[url] = transfer;
+		}
+
+		try {
+
+			transfer->temp = File::Temporary::create();
+			std::string filename = fetch(transfer->temp.c_str());
+
+			lock_guard<mutex> lock(guard);
+			transfer->filename = filename;
+			transfer->done = true;
+
+		} catch(...) {
+
+			lock_guard<mutex> lock(guard);
+			transfer->failed = current_exception();
+			transfers.erase(url);
+			changed.notify_all();
+			throw;
+
+		}
+
+		changed.notify_all();
+		return transfer;
+
+	}
+
+ }
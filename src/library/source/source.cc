@@ -21,6 +21,7 @@
  #include <udjat/defs.h>
  #include <udjat/version.h>
  #include <reinstall/source.h>
+ #include <reinstall/repository.h>
  #include <udjat/tools/quark.h>
  #include <udjat/tools/protocol.h>
  #include <udjat/tools/url.h>
@@ -66,12 +67,17 @@
 			url{getAttribute(node,"url",defurl)},
 			repository{getAttribute(node,"repository","install")},
 			path{getAttribute(node,"path",defpath)},
-			message{getAttribute(node,"download-message","")} {
+			message{getAttribute(node,"download-message","")},
+			cache{node.attribute("cache").as_bool(Config::Value<bool>("cache","default",false))},
+			listings{node.attribute("cache").as_bool(true)} {
 
 		if(!url[0]) {
 			throw runtime_error(string{"Missing required attribute 'url' on node "} + name());
 		}
 
+		checksum.sha256 = getAttribute(node,"sha256","");
+		checksum.url = getAttribute(node,"checksum-url","");
+
 		if(url[0] == '/' && !path[0]) {
 			path = url;
 		}
@@ -86,9 +92,55 @@
 		}
 	}
 
+	std::shared_ptr<Checksum> Source::ChecksumFactory() const {
+
+		if(checksum.sha256[0]) {
+			return make_shared<Checksum>(checksum.sha256);
+		}
+
+		if(checksum.url[0]) {
+			return make_shared<Checksum>(Checksum::fetch(checksum.url,url).c_str());
+		}
+
+		return std::shared_ptr<Checksum>();
+
+	}
+
+	bool Source::folder() const noexcept {
+		size_t length = strlen(url);
+		return length > 7 && url[length-1] == '/' && strncasecmp(url,"file://",7) == 0;
+	}
+
+	bool Source::remote() const noexcept {
+		return !saved() && strstr(url,"://") && strncasecmp(url,"file://",7);
+	}
+
+	void Source::route(Repository &repository) {
+
+		bool checked = false;
+		std::string routed{repository.local(url,length,checksum.sha256,checked)};
+
+		if(routed.empty()) {
+			routed = repository.mirror(url);
+			if(strcmp(routed.c_str(),url)) {
+				// Keep the repository URL, it's the fallback if the mirror fails.
+				origin = url;
+			}
+		} else {
+			Logger::String{"Using local copy '",routed.c_str()+7,"'"}.trace(name());
+			verified = checked;
+		}
+
+		if(strcmp(routed.c_str(),url)) {
+			url = Quark{routed}.c_str();
+		}
+
+	}
+
 	void Source::set(const Reinstall::Action &object) {
 
 		Udjat::String expander;
+		std::shared_ptr<Repository> routing;
 
 		// Expand URL.
 		{
@@ -100,18 +152,29 @@
 			if(expander[0] == '/' || expander[0] == '.') {
 
 				// Expand URL based on repository path
-				URL url{object.repository(repository)->get_url(true)};
+				auto repository = object.repository(this->repository);
+				URL url{repository->get_url(true)};
 				url += expander.c_str();
 				expander = url.c_str();
 				expander.expand(object);
 
+				// Route files to the local copy or fastest mirror, folders are listed from the repository.
+				if(expander[expander.size()-1] != '/') {
+					routing = repository;
+				}
+
 			} else if(strncasecmp(expander.c_str(),"relurl://",9) == 0) {
 
-				URL url{object.repository(repository)->get_url(true)};
+				auto repository = object.repository(this->repository);
+				URL url{repository->get_url(true)};
 				url += (expander.c_str()+9);
 				expander = url.c_str();
 				expander.expand(object);
 
+				if(expander[expander.size()-1] != '/') {
+					routing = repository;
+				}
+
 			}
 
 			if(strcmp(expander.c_str(),this->url)) {
@@ -121,6 +184,38 @@
 			debug("URL=",this->url);
 		}
 
+		// Expand checksum URL
+		if(checksum.url[0]) {
+
+			if(checksum.url[0] == '.') {
+
+				// Suffix, the checksum file is next to the source (ex: '.sha256').
+				expander = this->url;
+				expander += checksum.url;
+
+			} else {
+
+				expander = checksum.url;
+				expander.expand(object);
+
+				if(expander[0] == '/') {
+					URL url{object.repository(repository)->get_url(true)};
+					url += expander.c_str();
+					expander = url.c_str();
+				}
+
+			}
+
+			checksum.url = Quark{expander}.c_str();
+			debug("Checksum URL=",checksum.url);
+
+		}
+
+		// Route after the checksum URL, it's always got from the remote repository.
+		if(routing) {
+			route(*routing);
+		}
+
 		// Expand path
 		if(this->path && this->path[0]) {
 			expander = this->path;
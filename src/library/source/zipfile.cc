@@ -20,13 +20,25 @@
  #include <config.h>
  #include <reinstall/defs.h>
  #include <reinstall/source.h>
+ #include <reinstall/action.h>
  #include <reinstall/sources/zipfile.h>
- #include <reinstall/dialogs/progress.h>
+ #include <private/meter.h>
  #include <pugixml.hpp>
  #include <udjat/tools/intl.h>
  #include <iostream>
  #include <udjat/tools/logger.h>
  #include <udjat/tools/file.h>
+ #include <udjat/tools/quark.h>
+ #include <udjat/tools/string.h>
+ #include <udjat/tools/xml.h>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
+ #include <private/cache.h>
+ #include <cstdint>
+ #include <cstring>
+ #include <fnmatch.h>
+ #include <mutex>
+ #include <vector>
  #include <sys/stat.h>
  #include <fcntl.h>
  #include <unistd.h>
@@ -42,29 +54,377 @@
 
 #ifdef HAVE_ZIPLIB
 
+	static void patterns(const pugi::xml_node &node, const char *name, std::vector<std::string> &list) {
+		for(auto &pattern : String{XML::StringFactory(node,name).c_str()}.split(",")) {
+			pattern.strip();
+			if(!pattern.empty()) {
+				list.emplace_back(pattern.c_str());
+			}
+		}
+	}
+
 	ZipFile::ZipFile(const pugi::xml_node &node) : Source{node} {
+		patterns(node,"include",include);
+		patterns(node,"exclude",exclude);
+	}
+
+	bool ZipFile::selected(const char *name) const noexcept {
+
+		for(const std::string &pattern : exclude) {
+			if(!fnmatch(pattern.c_str(),name,0)) {
+				return false;
+			}
+		}
+
+		if(include.empty()) {
+			return true;
+		}
+
+		for(const std::string &pattern : include) {
+			if(!fnmatch(pattern.c_str(),name,0)) {
+				return true;
+			}
+		}
+
+		return false;
 
 	}
 
+	static inline uint16_t le16(const char *ptr) noexcept {
+		const uint8_t *p = (const uint8_t *) ptr;
+		return p[0] | (p[1] << 8);
+	}
+
+	static inline uint32_t le32(const char *ptr) noexcept {
+		return le16(ptr) | (((uint32_t) le16(ptr+2)) << 16);
+	}
+
+	static inline uint64_t le64(const char *ptr) noexcept {
+		return le32(ptr) | (((uint64_t) le32(ptr+4)) << 32);
+	}
+
+	/// @brief Remote zip archive, read with range requests.
+	class UDJAT_PRIVATE RemoteArchive {
+	public:
+
+		const std::string url;
+
+		/// @brief The archive length.
+		const unsigned long long length;
+
+		/// @brief Offset of the central directory.
+		unsigned long long offset = 0;
+
+		/// @brief Central directory and end records, from offset to the end of the archive.
+		std::string tail;
+
+		/// @brief Get range from server.
+		std::string get(unsigned long long from, size_t size) const {
+
+			std::string buffer;
+			buffer.reserve(size);
+
+			auto worker = Protocol::WorkerFactory(url.c_str());
+			worker->request("Range") = (string{"bytes="} + std::to_string(from) + "-" + std::to_string(from+size-1));
+
+			bool first = true;
+			worker->save([&](unsigned long long, unsigned long long, const void *buf, size_t bytes){
+
+				if(first) {
+					first = false;
+					if(worker->response("Content-Range").empty()) {
+						throw runtime_error(_("Server has ignored the range request"));
+					}
+				}
+
+				bytes = std::min(bytes,size - buffer.size());
+				buffer.append((const char *) buf,bytes);
+
+				return buffer.size() < size;
+
+			});
+
+			if(buffer.size() != size) {
+				throw runtime_error(_("Unexpected length"));
+			}
+
+			return buffer;
+
+		}
+
+		RemoteArchive(const char *u, unsigned long long l) : url{u}, length{l} {
+
+			// The end of central directory record is on the last 22 bytes + comment (up to 64K).
+			offset = (length > 65557 ? length - 65557 : 0);
+			tail = get(offset,length-offset);
+
+			if(tail.size() < 22) {
+				throw runtime_error(Logger::Message(_("'{}' is not a zip file"),url));
+			}
+
+			size_t eocd = tail.size() - 22;
+			while(le32(tail.c_str()+eocd) != 0x06054b50) {
+				if(!eocd--) {
+					throw runtime_error(Logger::Message(_("'{}' is not a zip file"),url));
+				}
+			}
+
+			unsigned long long cdoffset = le32(tail.c_str()+eocd+16);
+
+			if(cdoffset == 0xFFFFFFFF) {
+
+				// ZIP64, get the central directory offset from the ZIP64 end record.
+				if(eocd < 20 || le32(tail.c_str()+eocd-20) != 0x07064b50) {
+					throw runtime_error(Logger::Message(_("Invalid ZIP64 locator on '{}'"),url));
+				}
+
+				unsigned long long record = le64(tail.c_str()+eocd-20+8);
+				std::string zip64 = (record >= offset ? tail.substr(record-offset,56) : get(record,56));
+
+				if(zip64.size() < 56 || le32(zip64.c_str()) != 0x06064b50) {
+					throw runtime_error(Logger::Message(_("Invalid ZIP64 end record on '{}'"),url));
+				}
+
+				cdoffset = le64(zip64.c_str()+48);
+
+			}
+
+			if(cdoffset > length) {
+				throw runtime_error(Logger::Message(_("Invalid central directory offset on '{}'"),url));
+			}
+
+			if(cdoffset < offset) {
+				tail.insert(0,get(cdoffset,offset-cdoffset));
+				offset = cdoffset;
+			}
+
+			Logger::String{"Got ",tail.size()," bytes of central directory from '",url,"'"}.trace("zip");
+
+		}
+
+	};
+
+	/// @brief Read state of a libzip source backed by a remote archive.
+	struct UDJAT_PRIVATE RemoteReader {
+
+		std::shared_ptr<RemoteArchive> archive;
+		zip_uint64_t offset = 0;
+		zip_error_t error;
+
+		/// @brief Read ahead buffer.
+		struct {
+			zip_uint64_t offset = 0;
+			std::string data;
+		} window;
+
+		/// @brief Read ahead length.
+		size_t readahead;
+
+		RemoteReader(std::shared_ptr<RemoteArchive> a) : archive{a} {
+			zip_error_init(&error);
+			readahead = (size_t) Action::getImageSize(Config::Value<string>("zip","read-ahead","1MB").c_str());
+			if(readahead < 65536) {
+				readahead = 65536;
+			}
+		}
+
+		~RemoteReader() {
+			zip_error_fini(&error);
+		}
+
+		zip_int64_t read(void *data, zip_uint64_t len) {
+
+			if(offset >= archive->length) {
+				return 0;
+			}
+
+			len = std::min(len,archive->length - offset);
+
+			if(offset >= archive->offset) {
+
+				// Central directory, already in memory.
+				memcpy(data,archive->tail.c_str() + (offset - archive->offset),len);
+
+			} else {
+
+				// Entry data, get it from server.
+				len = std::min(len,archive->offset - offset);
+
+				if(offset < window.offset || (offset + len) > (window.offset + window.data.size())) {
+					window.offset = offset;
+					window.data = archive->get(offset,(size_t) std::min((zip_uint64_t) std::max((size_t) len,readahead),archive->offset - offset));
+				}
+
+				memcpy(data,window.data.c_str() + (offset - window.offset),len);
+
+			}
+
+			offset += len;
+			return (zip_int64_t) len;
+
+		}
+
+		static zip_int64_t callback(void *userdata, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+
+			RemoteReader *reader = (RemoteReader *) userdata;
+
+			switch(cmd) {
+			case ZIP_SOURCE_OPEN:
+				reader->offset = 0;
+				return 0;
+
+			case ZIP_SOURCE_READ:
+				try {
+					return reader->read(data,len);
+				} catch(const std::exception &e) {
+					Logger::String{"Error reading '",reader->archive->url,"': ",e.what()}.error("zip");
+					zip_error_set(&reader->error,ZIP_ER_READ,EIO);
+					return -1;
+				}
+
+			case ZIP_SOURCE_CLOSE:
+				return 0;
+
+			case ZIP_SOURCE_STAT:
+				{
+					zip_stat_t *st = (zip_stat_t *) data;
+					zip_stat_init(st);
+					st->size = reader->archive->length;
+					st->valid |= ZIP_STAT_SIZE;
+					return sizeof(*st);
+				}
+
+			case ZIP_SOURCE_ERROR:
+				return zip_error_to_data(&reader->error,data,len);
+
+			case ZIP_SOURCE_FREE:
+				delete reader;
+				return 0;
+
+			case ZIP_SOURCE_SEEK:
+				{
+					zip_int64_t pos = zip_source_seek_compute_offset(reader->offset,reader->archive->length,data,len,&reader->error);
+					if(pos < 0) {
+						return -1;
+					}
+					reader->offset = (zip_uint64_t) pos;
+					return 0;
+				}
+
+			case ZIP_SOURCE_TELL:
+				return (zip_int64_t) reader->offset;
+
+			case ZIP_SOURCE_SUPPORTS:
+				return zip_source_make_command_bitmap(
+					ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR,
+					ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, -1
+				);
+
+			default:
+				zip_error_set(&reader->error,ZIP_ER_OPNOTSUPP,0);
+				return -1;
+			}
+
+		}
+
+	};
+
 	bool ZipFile::contents(const Action &action, std::vector<std::shared_ptr<Source>> &contents) {
 
 		struct Container {
 
 			std::string filename;
+			std::shared_ptr<RemoteArchive> remote;
 			zip_t *handler;
 
-			Container(const char *name) : filename{name}, handler{zip_open(name,ZIP_RDONLY,NULL)} {
+			/// @brief Extract entries on the download workers?
+			bool parallel;
+
+			/// @brief Handlers for reading entries, one for every worker.
+			std::mutex guard;
+			std::vector<zip_t *> idle;
+
+			Container(const char *name) : filename{name}, handler{open()}, parallel{Config::Value<bool>("zip","parallel",true)} {
 				Logger::String{"Opening ",filename}.trace("zip");
-				if(!handler) {
-					throw runtime_error(string("Cant open '") + filename + "'");
-				}
+			}
+
+			Container(std::shared_ptr<RemoteArchive> r) : filename{r->url}, remote{r}, handler{open()}, parallel{true} {
+				Logger::String{"Opening remote ",filename}.trace("zip");
 			}
 
 			~Container() {
 				Logger::String{"Closing ",filename}.trace("zip");
+				for(zip_t *zip : idle) {
+					zip_discard(zip);
+				}
 				zip_close(handler);
 			}
 
+			/// @brief Open another handler, libzip handlers cant be shared between threads.
+			zip_t * open() const {
+
+				zip_error_t error;
+				zip_error_init(&error);
+
+				zip_t *zip = nullptr;
+
+				if(remote) {
+
+					RemoteReader *reader = new RemoteReader(remote);
+
+					zip_source_t *source = zip_source_function_create(RemoteReader::callback,reader,&error);
+					if(!source) {
+						delete reader;
+						string message{zip_error_strerror(&error)};
+						zip_error_fini(&error);
+						throw runtime_error(message);
+					}
+
+					zip = zip_open_from_source(source,ZIP_RDONLY,&error);
+					if(!zip) {
+						zip_source_free(source);
+					}
+
+				} else {
+
+					int code = 0;
+					zip = zip_open(filename.c_str(),ZIP_RDONLY,&code);
+					if(!zip) {
+						zip_error_set(&error,code,errno);
+					}
+
+				}
+
+				if(!zip) {
+					string message{string("Cant open '") + filename + "': " + zip_error_strerror(&error)};
+					zip_error_fini(&error);
+					throw runtime_error(message);
+				}
+
+				zip_error_fini(&error);
+				return zip;
+
+			}
+
+			/// @brief Get an idle handler.
+			zip_t * acquire() {
+				{
+					lock_guard<mutex> lock(guard);
+					if(!idle.empty()) {
+						zip_t *zip = idle.back();
+						idle.pop_back();
+						return zip;
+					}
+				}
+				return open();
+			}
+
+			/// @brief Return handler to the idle list.
+			void release(zip_t *zip) {
+				lock_guard<mutex> lock(guard);
+				idle.push_back(zip);
+			}
+
 		};
 
 		class ZipFileSource : public Reinstall::Source {
@@ -72,35 +432,74 @@
 			shared_ptr<Container> container;
 			struct zip_stat file;
 
+			/// @brief Extract on the scheduler workers? (copied, the container is released by the worker).
+			const bool parallel;
+
 		public:
 			ZipFileSource(shared_ptr<Container> c, const char *name, struct zip_stat &f)
-				: Reinstall::Source{name,Quark{string{"zip:///"}+f.name}.c_str(),Quark{f.name}.c_str()}, container{c}, file{f} {
+				: Reinstall::Source{name,Quark{string{"zip:///"}+f.name}.c_str(),Quark{f.name}.c_str()}, container{c}, file{f}, parallel{c->parallel} {
+				length = f.size;
+			}
+
+			bool remote() const noexcept override {
+				// Let the scheduler workers extract (and download) the entries in parallel.
+				return !saved() && parallel;
+			}
+
+			void save() override {
+
+				if(saved()) {
+					warning() << "Already downloaded" << endl;
+					return;
+				}
+
+				filenames.temp = File::Temporary::create();
+				save(filenames.temp.c_str());
+				filenames.saved = filenames.temp;
+
 			}
 
 			void save(const std::function<void(const void *buf, size_t length)> &write) override {
 
-				zip_file *zf = zip_fopen_index(container->handler, file.index, 0);
+				if(saved()) {
+					Source::save(write);
+					return;
+				}
+
+				zip_t *handler = container->acquire();
+
+				zip_file *zf = zip_fopen_index(handler, file.index, 0);
+				if(!zf) {
+					string message{zip_strerror(handler)};
+					container->release(handler);
+					throw runtime_error(message);
+				}
 
-				Dialog::Progress &progress = Dialog::Progress::getInstance();
+				Meter::Progress progress;
 				progress.set_url(this->path);
 
 				try {
 
-					size_t sum = 0;
-					char buffer[4096];
+					zip_uint64_t sum = 0;
+					std::vector<char> buffer((size_t) std::min(file.size,(zip_uint64_t) 0x40000) + 1);
 					while (sum != file.size) {
-						auto bufferlength = zip_fread(zf, buffer, 4096);
-						write(buffer,bufferlength);
+						auto bufferlength = zip_fread(zf, buffer.data(), buffer.size());
+						if(bufferlength <= 0) {
+							throw runtime_error(Logger::Message(_("Error reading '{}' from zip file"),file.name));
+						}
+						write(buffer.data(),bufferlength);
 						sum += bufferlength;
 						progress.set_progress((double) sum,(double) file.size);
 					}
 
 				} catch(...) {
 					zip_fclose(zf);
+					container->release(handler);
 					throw;
 				}
 
 				zip_fclose(zf);
+				container->release(handler);
 				progress.set_url("");
 
 			}
@@ -115,6 +514,10 @@
 				int out = ::open(filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
 #endif // _WIN32
 
+				if(out < 0) {
+					throw system_error(errno,system_category(),filename);
+				}
+
 				try {
 
 					save([out](const void *buffer, size_t length){
@@ -125,25 +528,49 @@
 
 				} catch(...) {
 
-					Logger::String{"Download of ",filename," was aborted"};
+					Logger::String{"Download of ",filename," was aborted"}.warning(name());
 					::close(out);
 					throw;
 				}
 
 				::close(out);
 
-
+				// Extracted, release the archive (only the thread saving the entry uses it).
 				container.reset();
 
 			}
 
 		};
 
-		if(filenames.saved.empty()) {
-			save();
+		shared_ptr<Container> container;
+
+		if(filenames.saved.empty() && !cache && strncasecmp(url,"http",4) == 0 && Config::Value<bool>("zip","remote",true)) {
+
+			// Remote archive, get the central directory and only the selected entries.
+			try {
+
+				Cache::Validators validators{url};
+				if(validators.ranges && validators.length) {
+					container = make_shared<Container>(make_shared<RemoteArchive>(url,validators.length));
+				}
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant read '",url,"' with range requests: ",e.what()}.warning(name());
+
+			}
+
 		}
 
-		shared_ptr<Container> container = make_shared<Container>(filenames.saved.c_str());
+		if(!container) {
+
+			if(filenames.saved.empty()) {
+				save();
+			}
+
+			container = make_shared<Container>(filename());
+
+		}
 
 		// https://gist.github.com/sdasgup3/a0255ebce3e3eec03e6878b47c8c7059
 		auto entries = zip_get_num_entries(container->handler,0);
@@ -155,9 +582,16 @@
 				continue;
 			}
 
+			if(!selected(sb.name)) {
+				debug("Ignoring ",sb.name);
+				continue;
+			}
+
 			debug(entry," - ",sb.index," - ",sb.name);
 
-			contents.push_back(make_shared<ZipFileSource>(container,name(),sb));
+			auto source = make_shared<ZipFileSource>(container,name(),sb);
+			contents.push_back(source);
+			action.prefetch(source);
 
 		}
 
@@ -41,6 +41,14 @@
 		return true;
 	}
 
+	bool Builder::graft() const noexcept {
+		return false;
+	}
+
+	bool Builder::lazy(const Source &) const noexcept {
+		return false;
+	}
+
 	size_t Builder::size() {
 		return 0;
 	}
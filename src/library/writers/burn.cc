@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <reinstall/defs.h>
+ #include <reinstall/writer.h>
+ #include <reinstall/action.h>
+ #include <reinstall/dialogs/progress.h>
+ #include <udjat/tools/intl.h>
+ #include <udjat/tools/logger.h>
+ #include <udjat/tools/configuration.h>
+ #include <system_error>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+ #include <deque>
+ #include <vector>
+ #include <chrono>
+ #include <cstdlib>
+ #include <cstdint>
+ #include <sys/types.h>
+ #include <sys/stat.h>
+
+ #ifndef _WIN32
+	#include <unistd.h>
+ #endif // _WIN32
+
+ using namespace std;
+ using namespace Udjat;
+
+ namespace Reinstall {
+
+	/// @brief Aligned data block.
+	struct Block {
+		void *data = nullptr;
+		size_t length = 0;
+	};
+
+	unsigned long long Writer::burn(unsigned long long total, const std::function<size_t(void *buf, size_t length)> &read) {
+
+		size_t blocksize = (size_t) Action::getImageSize(Config::Value<string>("burn","buffer-size","4MB").c_str());
+		size_t count = Config::Value<unsigned int>("burn","buffers",4);
+
+		// Multiple of the iso sector, aligned for O_DIRECT devices.
+		blocksize = std::max(blocksize,(size_t) 65536) & ~((size_t) 4095);
+		count = std::max(count,(size_t) 2);
+
+		std::vector<void *> buffers;
+		std::deque<Block> available, filled;
+
+		for(size_t ix = 0; ix < count; ix++) {
+			void *ptr = nullptr;
+			if(posix_memalign(&ptr,4096,blocksize)) {
+				for(void *buffer : buffers) {
+					free(buffer);
+				}
+				throw system_error(ENOMEM,system_category(),_("Cant allocate image buffers"));
+			}
+			buffers.push_back(ptr);
+			available.push_back(Block{ptr,0});
+		}
+
+		std::mutex guard;
+		std::condition_variable changed;
+		std::exception_ptr failed;
+		bool eof = false;
+		bool cancelled = false;
+
+		// Read on a secondary thread, write on this one.
+		std::thread reader{[&](){
+
+			try {
+
+				while(true) {
+
+					Block block;
+
+					{
+						unique_lock<mutex> lock(guard);
+						changed.wait(lock,[&]{
+							return cancelled || !available.empty();
+						});
+						if(cancelled) {
+							return;
+						}
+						block = available.front();
+						available.pop_front();
+					}
+
+					// Fill the block, the source can return less than requested.
+					block.length = 0;
+					while(block.length < blocksize) {
+						size_t bytes = read(((uint8_t *) block.data) + block.length, blocksize - block.length);
+						if(!bytes) {
+							break;
+						}
+						block.length += bytes;
+					}
+
+					{
+						lock_guard<mutex> lock(guard);
+						if(block.length) {
+							filled.push_back(block);
+						}
+						if(block.length < blocksize) {
+							eof = true;
+						}
+					}
+					changed.notify_all();
+
+					if(block.length < blocksize) {
+						return;
+					}
+
+				}
+
+			} catch(...) {
+
+				lock_guard<mutex> lock(guard);
+				failed = current_exception();
+				changed.notify_all();
+
+			}
+
+		}};
+
+		Dialog::Progress &progress = Dialog::Progress::getInstance();
+		auto updated = std::chrono::steady_clock::now();
+		unsigned long long current = 0;
+
+		try {
+
+			while(true) {
+
+				Block block;
+
+				{
+					unique_lock<mutex> lock(guard);
+					changed.wait(lock,[&]{
+						return failed || eof || !filled.empty();
+					});
+
+					if(failed) {
+						rethrow_exception(failed);
+					}
+
+					if(filled.empty()) {
+						break;
+					}
+
+					block = filled.front();
+					filled.pop_front();
+				}
+
+				write(block.data,block.length);
+				current += block.length;
+
+				{
+					lock_guard<mutex> lock(guard);
+					available.push_back(block);
+				}
+				changed.notify_all();
+
+				// Don't flood the dialog with updates.
+				auto now = std::chrono::steady_clock::now();
+				if(now - updated >= std::chrono::milliseconds(250)) {
+					updated = now;
+					progress.set_progress(current,total);
+				}
+
+			}
+
+		} catch(...) {
+
+			{
+				lock_guard<mutex> lock(guard);
+				cancelled = true;
+			}
+			changed.notify_all();
+			reader.join();
+
+			for(void *buffer : buffers) {
+				free(buffer);
+			}
+			throw;
+
+		}
+
+		reader.join();
+
+		for(void *buffer : buffers) {
+			free(buffer);
+		}
+
+		progress.set_progress(current,total);
+
+		if(total && current != total) {
+			throw runtime_error(Logger::Message(_("Unexpected image length, expecting {} got {}"),total,current));
+		}
+
+		Logger::String{"Image with ",current," bytes was written using ",count," buffer(s) of ",blocksize," bytes"}.trace("writer");
+
+		return current;
+
+	}
+
+	unsigned long long Writer::burn(int fd) {
+
+		struct stat st;
+		if(fstat(fd,&st)) {
+			throw system_error(errno,system_category(),_("Cant get image size"));
+		}
+
+		off_t offset = 0;
+
+		return burn(st.st_size,[fd,&offset](void *buf, size_t length) -> size_t {
+
+			while(true) {
+
+				ssize_t bytes = pread(fd,buf,length,offset);
+
+				if(bytes < 0 && errno == EINTR) {
+					continue;
+				} else if(bytes < 0) {
+					throw system_error(errno,system_category(),_("Cant read from image file"));
+				}
+
+				offset += bytes;
+				return (size_t) bytes;
+
+			}
+
+		});
+
+	}
+
+ }
@@ -27,6 +27,10 @@
  #include <sys/types.h>
  #include <sys/stat.h>
  #include <fcntl.h>
+ #include <thread>
+ #include <atomic>
+ #include <udjat/tools/protocol.h>
+ #include <udjat/tools/configuration.h>
 
  #ifndef _WIN32
 	#include <unistd.h>
@@ -36,11 +40,16 @@
  using namespace Udjat;
  using namespace Reinstall;
 
- IsoWriter::IsoWriter(const pugi::xml_node &node) : Reinstall::Action(node,"drive-removable-media") {
+ IsoWriter::IsoWriter(const pugi::xml_node &node)
+	: Reinstall::Action(node,"drive-removable-media"),
+		streaming{node.attribute("streaming").as_bool(Config::Value<bool>("iso-writer","streaming",false))} {
 
 	class Source : public Reinstall::Source {
+	private:
+		bool streaming;
+
 	public:
-		Source(const pugi::xml_node &node, const char *defmessage) : Reinstall::Source{node} {
+		Source(const pugi::xml_node &node, const char *defmessage, bool s) : Reinstall::Source{node}, streaming{s} {
 			if(!(url && *url)) {
 				throw runtime_error(_("Required attribute 'URL' is missing"));
 			}
@@ -48,6 +57,12 @@
 				message = defmessage;
 			}
 		}
+
+		bool remote() const noexcept override {
+			// When streaming the download is done by burn(), after the device selection.
+			return !streaming && Reinstall::Source::remote();
+		}
+
 	};
 
  	if(!sources.empty()) {
@@ -55,7 +70,7 @@
  	}
 
 	sources.clear(); // Remove other sources.
-	sources.push_back(make_shared<Source>(node,_("Downloading ISO image")));
+	sources.push_back(make_shared<Source>(node,_("Downloading ISO image"),streaming));
 
  }
 
@@ -64,9 +79,129 @@
 	class Builder : public Reinstall::Builder {
 	private:
 		int fd = -1;
+		bool streaming;
+		std::string url;
+		std::shared_ptr<Reinstall::Checksum> checksum;
+
+		/// @brief Wipe the start of a partially written device, it must not look like a valid image.
+		static void wipe(std::shared_ptr<Reinstall::Writer> writer) noexcept {
+
+			try {
+
+				// Reopening the writer rewinds it to the device start.
+				writer->close();
+				writer->open();
+
+				std::vector<uint8_t> zeros((size_t) Action::getImageSize(Config::Value<string>("iso-writer","wipe-size","1MB").c_str()),0);
+				writer->write(zeros.data(),zeros.size());
+				writer->finalize();
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant wipe the device start: ",e.what()}.error("isowriter");
+
+			}
+
+		}
+
+		/// @brief Download image directly to the device.
+		std::shared_ptr<Reinstall::Writer> stream(std::shared_ptr<Reinstall::Writer> writer) {
+
+			Reinstall::Dialog::Progress &progress = Reinstall::Dialog::Progress::getInstance();
+			progress.set_sub_title(_("Writing ISO image"));
+			progress.set_url(url.c_str());
+
+			RingBuffer buffer{(size_t) Action::getImageSize(Config::Value<string>("iso-writer","buffer-size","64MB").c_str())};
+			std::atomic<unsigned long long> total{0};
+			std::exception_ptr failed;
+
+			Logger::String{"Streaming '",url,"' to device"}.trace("isowriter");
+
+			// Download on a secondary thread, write on this one.
+			std::thread producer{[this,&buffer,&total,&failed](){
+
+				try {
+
+					Protocol::WorkerFactory(url.c_str())->save([this,&buffer,&total](unsigned long long, unsigned long long length, const void *buf, size_t bytes){
+						total = length;
+						if(checksum) {
+							checksum->update(buf,bytes);
+						}
+						return buffer.write(buf,bytes);
+					});
+
+				} catch(...) {
+
+					failed = current_exception();
+
+				}
+
+				buffer.close();
+
+			}};
+
+			unsigned long long current = 0;
+
+			try {
+
+				std::vector<uint8_t> block(1048576);
+
+				size_t bytes;
+				while((bytes = buffer.read(block.data(),block.size())) > 0) {
+					writer->write(block.data(),bytes);
+					current += bytes;
+					progress.set_progress(current,total);
+				}
+
+			} catch(...) {
+
+				buffer.cancel();
+				producer.join();
+
+				if(current) {
+					wipe(writer);
+				}
+				throw;
+
+			}
+
+			producer.join();
+
+			// The image is already on the device, any failure now leaves invalid contents.
+			try {
+
+				if(failed) {
+					rethrow_exception(failed);
+				}
+
+				if(!current || (total && current != total)) {
+					throw runtime_error(_("Unexpected EOF reading image file"));
+				}
+
+				checksum->verify(url.c_str());
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Streaming '",url,"' has failed: ",e.what()}.error("isowriter");
+
+				if(current) {
+					wipe(writer);
+					throw runtime_error(_("The image written on the device is not valid and was erased, try again without streaming"));
+				}
+				throw;
+
+			}
+
+			progress.set_sub_title(_("Finalizing"));
+			writer->finalize();
+
+			return writer;
+
+		}
 
 	public:
-		Builder() = default;
+		Builder(bool s) : streaming{s} {
+		}
 
 		~Builder() {
 			if(fd > 0) {
@@ -99,7 +234,7 @@
 
 		bool apply(Reinstall::Source &source) override {
 
-			if(fd > 0) {
+			if(fd > 0 || !url.empty()) {
 				throw runtime_error(_("More sources than module expects"));
 			}
 
@@ -107,6 +242,20 @@
 				return false;
 			}
 
+			if(streaming && !source.saved()) {
+
+				// Stream only verified images, the device contents can't be checked after writing.
+				checksum = source.ChecksumFactory();
+				if(checksum) {
+					// Download will be done by burn().
+					url = source.url;
+					return true;
+				}
+
+				Logger::String{"No digest for '",source.url,"', downloading it before writing"}.warning("isowriter");
+
+			}
+
 			source.save();
 
 			fd = ::open(source.filename(),O_RDONLY);
@@ -127,40 +276,18 @@
 
 		std::shared_ptr<Reinstall::Writer> burn(std::shared_ptr<Reinstall::Writer> writer) override {
 
+			if(!url.empty()) {
+				return stream(writer);
+			}
+
 			Reinstall::Dialog::Progress &progress = Reinstall::Dialog::Progress::getInstance();
 			progress.set_sub_title(_("Writing ISO image"));
 
-			size_t current = 0;
-			size_t total = size();
 			if(!size()) {
 				throw runtime_error(_("Unable to get image size"));
 			}
 
-			#define BUFLEN 2048
-			unsigned char buffer[BUFLEN];
-
-			while(current < total) {
-
-				size_t length = (total - current);
-				if(length > BUFLEN) {
-					length = BUFLEN;
-				}
-
-				ssize_t bytes = ::read(fd, buffer, length);
-				if(bytes < 0) {
-					throw system_error(errno,system_category(),_("Cant read from image file"));
-				}
-
-				if(bytes == 0) {
-					throw runtime_error(_("Unexpected EOF reading image file"));
-				}
-
-				writer->write(buffer,length);
-
-				current += length;
-				progress.set_progress(current,total);
-
-			}
+			writer->burn(fd);
 
 			progress.set_sub_title(_("Finalizing"));
 			writer->finalize();
@@ -171,7 +298,7 @@
 
 	};
 
-	return(make_shared<Builder>());
+	return(make_shared<Builder>(streaming));
 
  }
 
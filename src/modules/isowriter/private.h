@@ -23,9 +23,56 @@
  #include <udjat/tools/logger.h>
  #include <udjat/tools/intl.h>
  #include <reinstall/action.h>
+ #include <mutex>
+ #include <condition_variable>
+ #include <vector>
+ #include <cstdint>
+
+ /// @brief Bounded FIFO buffer between a producer and a consumer thread.
+ class UDJAT_PRIVATE RingBuffer {
+ private:
+	std::mutex guard;
+	std::condition_variable changed;
+	std::vector<uint8_t> buffer;
+
+	/// @brief Read position.
+	size_t head = 0;
+
+	/// @brief Bytes available for reading.
+	size_t used = 0;
+
+	/// @brief Producer has finished.
+	bool eof = false;
+
+	/// @brief Consumer has aborted.
+	bool cancelled = false;
+
+ public:
+	RingBuffer(size_t length);
+
+	/// @brief Append data, wait for free space if necessary.
+	/// @return false if the consumer has cancelled the transfer.
+	bool write(const void *buf, size_t length);
+
+	/// @brief Get data, wait until available.
+	/// @return Number of bytes read, 0 on end of data.
+	size_t read(void *buf, size_t length);
+
+	/// @brief No more data from producer.
+	void close() noexcept;
+
+	/// @brief Abort transfer, release the producer.
+	void cancel() noexcept;
+
+ };
 
  /// @brief Simple image writer, just write an ISO to USB Storage.
  class UDJAT_PRIVATE IsoWriter : public Reinstall::Action {
+ private:
+
+	/// @brief Send the download directly to the device, without temporary file.
+	bool streaming;
+
  public:
 	IsoWriter(const pugi::xml_node &node);
 	std::shared_ptr<Reinstall::Builder> BuilderFactory() override;
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2023 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include "private.h"
+ #include <cstring>
+
+ using namespace std;
+
+ RingBuffer::RingBuffer(size_t length) : buffer(length ? length : 1) {
+ }
+
+ bool RingBuffer::write(const void *buf, size_t length) {
+
+	const uint8_t *ptr = (const uint8_t *) buf;
+
+	while(length) {
+
+		unique_lock<mutex> lock(guard);
+		changed.wait(lock,[this]{
+			return cancelled || used < buffer.size();
+		});
+
+		if(cancelled) {
+			return false;
+		}
+
+		// Copy up to the end of the free block.
+		size_t tail = (head + used) % buffer.size();
+		size_t bytes = std::min(length, std::min(buffer.size() - used, buffer.size() - tail));
+
+		memcpy(buffer.data()+tail,ptr,bytes);
+		used += bytes;
+		ptr += bytes;
+		length -= bytes;
+
+		lock.unlock();
+		changed.notify_all();
+
+	}
+
+	return true;
+
+ }
+
+ size_t RingBuffer::read(void *buf, size_t length) {
+
+	unique_lock<mutex> lock(guard);
+	changed.wait(lock,[this]{
+		return cancelled || eof || used;
+	});
+
+	if(cancelled || !used) {
+		return 0;
+	}
+
+	// Copy up to the end of the used block.
+	size_t bytes = std::min(length, std::min(used, buffer.size() - head));
+
+	memcpy(buf,buffer.data()+head,bytes);
+	head = (head + bytes) % buffer.size();
+	used -= bytes;
+
+	lock.unlock();
+	changed.notify_all();
+
+	return bytes;
+
+ }
+
+ void RingBuffer::close() noexcept {
+	{
+		lock_guard<mutex> lock(guard);
+		eof = true;
+	}
+	changed.notify_all();
+ }
+
+ void RingBuffer::cancel() noexcept {
+	{
+		lock_guard<mutex> lock(guard);
+		cancelled = true;
+	}
+	changed.notify_all();
+ }
+